@@ -0,0 +1,486 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- alloctrace.cpp ---
+//
+//  An allocation tracer for the Project-1 programs.  It replaces malloc(),
+//    free() (and their relatives), and the global operator new and delete
+//    with versions that forward to glibc's allocator, recording:
+//
+//  - the number of calls to each function, and the time spent in them
+//  - a histogram of requested sizes.  Sizes up to 512 bytes are grouped
+//      in 16-byte classes (glibc's chunk granularity on 64-bit systems);
+//      larger ones in powers of two.
+//  - the allocator's overhead for each class:  the slack between the
+//      requested size and the block's usable size (malloc_usable_size()),
+//      plus the allocator's per-chunk header (8 bytes for heap chunks, and
+//      16 for the mmap()ed chunks glibc uses for large blocks)
+//  - the live and peak bytes in use, and the heap's fragmentation (free
+//      bytes the allocator is holding on to) near the peak, and at exit
+//
+//  The entry points traced are malloc(), calloc(), realloc(),
+//    reallocarray(), free(), memalign(), aligned_alloc(), posix_memalign(),
+//    valloc(), pvalloc(), and the global operator new and delete (the
+//    aligned variants are counted as memalign).  Memory obtained any other
+//    way (e.g., by calling mmap() directly, or glibc's internal
+//    allocations, which don't go through these symbols) isn't seen, so the
+//    totals are approximate.
+//
+//  The statistics are written to stderr (or the file named by the
+//    ALLOCTRACE_OUTPUT environment variable) when the program exits.
+//
+//  Use it either by preloading the shared library build with an unmodified
+//    program:
+//
+//      LD_PRELOAD=./liballoctrace.so ./new.out 10000
+//
+//  or by linking it into the program (see the "traced" rule in the
+//    Makefile).  Either way, nothing in here allocates memory, or calls
+//    anything that might, since that would recurse back into the tracer.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// glibc's allocator entry points, which our replacements forward to
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void  __libc_free(void*);
+}
+
+namespace {
+
+//---------------------------------------------------------------------------
+//
+//  Timing.  The time stamp counter is cheap enough to read around every
+//    call;  it's converted to nanoseconds at exit by comparing it to the
+//    clock over the program's run.
+//
+
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+double seconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1.0e-9 * now.tv_nsec;
+}
+
+//---------------------------------------------------------------------------
+//
+//  Statistics.  Everything is a relaxed atomic, so the tracer works with
+//    threaded programs, and is zero-initialized before any constructor
+//    runs (the dynamic loader may allocate before we're initialized).
+//
+
+enum Op { Malloc, Calloc, Realloc, Memalign, Free, New, NewArray, Delete,
+    DeleteArray, NumOps };
+
+const char* opNames[NumOps] = { "malloc", "calloc", "realloc", "memalign",
+    "free", "new", "new[]", "delete", "delete[]" };
+
+constexpr size_t ClassBytes = 16;
+constexpr size_t SmallLimit = 512;
+constexpr size_t NumSmall = SmallLimit / ClassBytes + 1;  // includes 0 bytes
+constexpr size_t NumClasses = NumSmall + 48;
+
+using Counter = std::atomic<uint64_t>;
+
+struct OpStats {
+    Counter calls;
+    Counter ticks;
+};
+
+struct ClassStats {
+    Counter count;
+    Counter requested;
+    Counter overhead;
+};
+
+struct HeapSnapshot {
+    size_t live;
+    size_t arena;
+    size_t inUse;
+    size_t free;
+};
+
+OpStats     ops[NumOps];
+ClassStats  classes[NumClasses];
+
+std::atomic<int64_t>  live;
+std::atomic<int64_t>  peak;
+std::atomic<int64_t>  nextSnapshot;
+std::atomic_flag      snapshotting = ATOMIC_FLAG_INIT;
+HeapSnapshot          atPeak;
+
+uint64_t startTicks;
+double   startTime;
+
+size_t sizeClass(size_t size) {
+    if (size <= SmallLimit) { return (size + ClassBytes - 1) / ClassBytes; }
+
+    size_t log2 = 64 - __builtin_clzll(size - 1);  // ceil(log2(size))
+    return std::min(NumSmall + log2 - 10, NumClasses - 1);
+}
+
+void classBounds(size_t c, size_t& lo, size_t& hi) {
+    if (c < NumSmall) {
+        lo = c ? (c - 1) * ClassBytes + 1 : 0;
+        hi = c * ClassBytes;
+        return;
+    }
+
+    size_t log2 = c - NumSmall + 10;
+    lo = (size_t(1) << (log2 - 1)) + 1;
+    hi = size_t(1) << log2;
+}
+
+HeapSnapshot snapshot() {
+    struct mallinfo2 info = mallinfo2();
+    return { size_t(live.load(std::memory_order_relaxed)),
+        info.arena + info.hblkhd, info.uordblks + info.hblkhd, info.fordblks };
+}
+
+// Account for a new block of "usable" bytes.  The heap's layout is
+//   sampled each time the peak grows by another 1/16th, so it's known
+//   (to within that) at the peak, without calling mallinfo2() on every
+//   allocation.
+void grow(size_t usable) {
+    int64_t now = live.fetch_add(usable, std::memory_order_relaxed) + usable;
+
+    int64_t high = peak.load(std::memory_order_relaxed);
+    while (now > high && !peak.compare_exchange_weak(high, now,
+        std::memory_order_relaxed)) {}
+
+    if (now > high && now >= nextSnapshot.load(std::memory_order_relaxed) &&
+        !snapshotting.test_and_set(std::memory_order_acquire))
+    {
+        atPeak = snapshot();
+        nextSnapshot.store(now + now / 16, std::memory_order_relaxed);
+        snapshotting.clear(std::memory_order_release);
+    }
+}
+
+void shrink(size_t usable)
+    { live.fetch_sub(usable, std::memory_order_relaxed); }
+
+inline void record(Op op, uint64_t start) {
+    ops[op].calls.fetch_add(1, std::memory_order_relaxed);
+    ops[op].ticks.fetch_add(ticks() - start, std::memory_order_relaxed);
+}
+
+// The allocator's bookkeeping in front of a chunk.  glibc keeps the
+//   chunk's size (with flags in its low bits) just before the memory it
+//   returns;  heap chunks share the previous-size field with their
+//   neighbor, but mmap()ed chunks (flagged IS_MMAPPED) have no neighbor,
+//   and use both fields.
+size_t headerBytes(const void* memory) {
+    const size_t IsMmapped = 0x2;
+
+    size_t size;
+    std::memcpy(&size, static_cast<const char*>(memory) - sizeof(size), sizeof(size));
+    return size & IsMmapped ? 2 * sizeof(size_t) : sizeof(size_t);
+}
+
+void allocated(void* memory, size_t size) {
+    if (memory == nullptr) { return; }
+
+    size_t usable = malloc_usable_size(memory);
+    ClassStats& c = classes[sizeClass(size)];
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.requested.fetch_add(size, std::memory_order_relaxed);
+    c.overhead.fetch_add(usable - size + headerBytes(memory), std::memory_order_relaxed);
+
+    grow(usable);
+}
+
+void* allocate(Op op, size_t size) {
+    uint64_t start = ticks();
+    void* memory = __libc_malloc(size);
+    record(op, start);
+    allocated(memory, size);
+    return memory;
+}
+
+void* allocateAligned(Op op, size_t alignment, size_t size) {
+    uint64_t start = ticks();
+    void* memory = __libc_memalign(alignment, size);
+    record(op, start);
+    allocated(memory, size);
+    return memory;
+}
+
+void release(Op op, void* memory) {
+    if (memory == nullptr) { return; }
+
+    shrink(malloc_usable_size(memory));
+
+    uint64_t start = ticks();
+    __libc_free(memory);
+    record(op, start);
+}
+
+// operator new's failure handling: call the new handler (which may free
+//   some memory) and retry, or throw if there isn't one
+void* allocateOrThrow(Op op, size_t size) {
+    void* memory;
+    while ((memory = allocate(op, size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) { throw std::bad_alloc(); }
+        handler();
+    }
+    return memory;
+}
+
+void* allocateAlignedOrThrow(Op op, size_t alignment, size_t size) {
+    void* memory;
+    while ((memory = allocateAligned(op, alignment, size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) { throw std::bad_alloc(); }
+        handler();
+    }
+    return memory;
+}
+
+//---------------------------------------------------------------------------
+//
+//  Reporting, using only snprintf() into a stack buffer and write()
+//
+
+struct Report {
+    int  fd;
+    char line[256];
+
+    template <typename... Args>
+    void print(const char* format, Args... args) {
+        int n = snprintf(line, sizeof(line), format, args...);
+        if (n > 0) { write(fd, line, std::min<size_t>(n, sizeof(line) - 1)); }
+    }
+};
+
+__attribute__((constructor))
+void start() {
+    startTicks = ticks();
+    startTime = seconds();
+}
+
+__attribute__((destructor))
+void dump() {
+    double nsPerTick = 1.0e9 * (seconds() - startTime) /
+        std::max<uint64_t>(ticks() - startTicks, 1);
+
+    Report report{ STDERR_FILENO, {} };
+    if (const char* path = getenv("ALLOCTRACE_OUTPUT")) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) { report.fd = fd; }
+    }
+
+    char name[256] = "?";
+    ssize_t n = readlink("/proc/self/exe", name, sizeof(name) - 1);
+    if (n > 0) { name[n] = '\0'; }
+
+    report.print("--- Allocations: %s (pid %d) ---\n", name, int(getpid()));
+
+    report.print("  %-10s %12s %12s\n", "Function", "Calls", "Avg. ns");
+    for (size_t op = 0; op < NumOps; ++op) {
+        uint64_t calls = ops[op].calls.load();
+        if (calls == 0) { continue; }
+        report.print("  %-10s %12llu %12.1f\n", opNames[op],
+            (unsigned long long) calls, nsPerTick * ops[op].ticks.load() / calls);
+    }
+
+    report.print("\n  %-14s %10s %14s %14s %10s\n", "Size (bytes)", "Blocks",
+        "Requested", "Overhead", "Overhead %");
+
+    uint64_t count = 0, requested = 0, overhead = 0;
+    for (size_t c = 0; c < NumClasses; ++c) {
+        uint64_t blocks = classes[c].count.load();
+        if (blocks == 0) { continue; }
+
+        uint64_t bytes = classes[c].requested.load();
+        uint64_t extra = classes[c].overhead.load();
+        count += blocks;
+        requested += bytes;
+        overhead += extra;
+
+        size_t lo, hi;
+        classBounds(c, lo, hi);
+        char range[48];
+        snprintf(range, sizeof(range), "%zu-%zu", lo, hi);
+        report.print("  %-14s %10llu %14llu %14llu %9.1f%%\n", range,
+            (unsigned long long) blocks, (unsigned long long) bytes,
+            (unsigned long long) extra, bytes ? 100.0 * extra / bytes : 0.0);
+    }
+
+    if (count > 0) {
+        report.print("  %-14s %10llu %14llu %14llu %9.1f%%\n", "Total",
+            (unsigned long long) count, (unsigned long long) requested,
+            (unsigned long long) overhead, requested ? 100.0 * overhead / requested : 0.0);
+        report.print("  Average request = %.1f bytes, overhead = %.1f bytes per block\n",
+            double(requested) / count, double(overhead) / count);
+    }
+
+    auto heap = [&](const char* when, const HeapSnapshot& s) {
+        report.print("  %-8s live = %zu  heap = %zu  in use = %zu  free = %zu"
+            "  (fragmentation = %.1f%%)\n", when, s.live, s.arena, s.inUse,
+            s.free, s.arena ? 100.0 * s.free / s.arena : 0.0);
+    };
+
+    report.print("\n  Peak live bytes = %lld\n", (long long) peak.load());
+    if (atPeak.arena) { heap("Peak:", atPeak); }
+    heap("Exit:", snapshot());
+
+    if (report.fd != STDERR_FILENO) { close(report.fd); }
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------
+//
+//  The C allocation functions
+//
+
+extern "C" {
+
+void* malloc(size_t size)
+    { return allocate(Malloc, size); }
+
+void free(void* memory)
+    { release(Free, memory); }
+
+void* calloc(size_t count, size_t size) {
+    uint64_t start = ticks();
+    void* memory = __libc_calloc(count, size);
+    record(Calloc, start);
+    allocated(memory, count * size);
+    return memory;
+}
+
+void* realloc(void* memory, size_t size) {
+    if (memory == nullptr) { return allocate(Realloc, size); }
+    if (size == 0) { release(Realloc, memory); return nullptr; }
+
+    size_t usable = malloc_usable_size(memory);
+
+    uint64_t start = ticks();
+    void* resized = __libc_realloc(memory, size);
+    record(Realloc, start);
+
+    if (resized != nullptr) {
+        shrink(usable);
+        allocated(resized, size);
+    }
+    return resized;
+}
+
+void* reallocarray(void* memory, size_t count, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(memory, total);
+}
+
+void* memalign(size_t alignment, size_t size)
+    { return allocateAligned(Memalign, alignment, size); }
+
+void* valloc(size_t size)
+    { return allocateAligned(Memalign, sysconf(_SC_PAGESIZE), size); }
+
+void* pvalloc(size_t size) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t rounded;
+    if (__builtin_add_overflow(size, pageSize - 1, &rounded)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return allocateAligned(Memalign, pageSize, rounded & ~(pageSize - 1));
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+    { return allocateAligned(Memalign, alignment, size); }
+
+int posix_memalign(void** memory, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1))) { return EINVAL; }
+
+    void* aligned = allocateAligned(Memalign, alignment, size);
+    if (aligned == nullptr) { return ENOMEM; }
+
+    *memory = aligned;
+    return 0;
+}
+
+} // extern "C"
+
+//---------------------------------------------------------------------------
+//
+//  The global operator new and delete
+//
+
+void* operator new(size_t size)
+    { return allocateOrThrow(New, size); }
+
+void* operator new[](size_t size)
+    { return allocateOrThrow(NewArray, size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+    { return allocate(New, size); }
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+    { return allocate(NewArray, size); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+    { return allocateAlignedOrThrow(New, size_t(alignment), size); }
+
+void* operator new[](size_t size, std::align_val_t alignment)
+    { return allocateAlignedOrThrow(NewArray, size_t(alignment), size); }
+
+void operator delete(void* memory) noexcept
+    { release(Delete, memory); }
+
+void operator delete[](void* memory) noexcept
+    { release(DeleteArray, memory); }
+
+void operator delete(void* memory, size_t) noexcept
+    { release(Delete, memory); }
+
+void operator delete[](void* memory, size_t) noexcept
+    { release(DeleteArray, memory); }
+
+void operator delete(void* memory, std::align_val_t) noexcept
+    { release(Delete, memory); }
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+    { release(DeleteArray, memory); }
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+    { release(Delete, memory); }
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept
+    { release(DeleteArray, memory); }
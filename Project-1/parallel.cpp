@@ -0,0 +1,177 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using Hash = unsigned long long;
+using Size = unsigned int;
+using Byte = unsigned char;
+
+//
+// A parallel version of malloc.cpp's chain builder.  The block sizes are
+//   drawn from rand() serially, in order (which is cheap), so the chain
+//   is the same as the serial programs' for the same seed, and so is its
+//   hash.  The chain is then divided into one contiguous segment per
+//   thread.  Each thread allocates a single arena large enough for its
+//   segment's nodes, constructs and fills them there, and links them
+//   together;  the segments are then concatenated in order.  No thread
+//   touches another's nodes, so no synchronization is needed beyond
+//   joining the threads.
+//
+//   Usage: parallel.out <Number of blocks> [<Number of threads>]
+//
+//   The build time and throughput are reported on stderr.
+//
+
+struct Node {
+    Node* next;
+    Size  numBytes;
+    Byte* bytes;
+
+    Node(Size n) : next(nullptr), numBytes(n) {
+        bytes = reinterpret_cast<Byte*>(this + 1);
+
+        std::iota(bytes, bytes + numBytes, 1);
+    }
+
+    // Bytes a node with "n" data bytes takes in an arena, keeping the
+    //   following node aligned
+    static size_t footprint(Size n)
+        { return (sizeof(Node) + n + alignof(Node) - 1) & ~(alignof(Node) - 1); }
+
+    Hash hash(void) {
+        const Hash multiplier = 2654435789;
+        Hash hashValue = 104395301;
+
+        for (Size i = 0; i < numBytes; ++i) {
+            hashValue += (multiplier * bytes[i]) ^ (hashValue >> 23);
+        }
+
+        return hashValue;
+    }
+};
+
+// One thread's part of the chain, and the arena its nodes live in
+struct Segment {
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    Byte* arena = nullptr;
+};
+
+Size getNumBytesForBlock() {
+    const Size MinBytes = MIN_BYTES;
+    const Size MaxBytes = MAX_BYTES;
+
+    return (rand() % MaxBytes) + MinBytes;
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <Number of blocks> [<Number of threads>]"
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Size numBlocks = std::stol(argv[1]);
+    Size numThreads = argc > 2 ? std::stol(argv[2])
+        : std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max(1u, numThreads);
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    std::vector<Size> sizes(numBlocks);
+    for (auto& size : sizes) {
+        size = getNumBytesForBlock();
+    }
+
+    auto sized = Clock::now();
+
+    std::vector<Segment>      segments(numThreads);
+    std::vector<std::thread>  threads;
+    std::atomic<bool>         failed{false};
+
+    for (Size id = 0; id < numThreads; ++id) {
+        threads.emplace_back([&, id]() {
+            size_t begin = size_t(numBlocks) * id / numThreads;
+            size_t end = size_t(numBlocks) * (id + 1) / numThreads;
+            if (begin == end) { return; }
+
+            size_t bytes = 0;
+            for (size_t i = begin; i < end; ++i) {
+                bytes += Node::footprint(sizes[i]);
+            }
+
+            Segment& segment = segments[id];
+            segment.arena = reinterpret_cast<Byte*>(malloc(bytes));
+            if (segment.arena == nullptr) {
+                failed = true;
+                return;
+            }
+
+            Byte* memory = segment.arena;
+            for (size_t i = begin; i < end; ++i) {
+                Node* node = new (memory) Node(sizes[i]);
+                memory += Node::footprint(sizes[i]);
+
+                if (segment.head == nullptr) {
+                    segment.head = node;
+                }
+                else {
+                    segment.tail->next = node;
+                }
+                segment.tail = node;
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (failed) {
+        std::cerr << "Node allocation failed\n";
+        return EXIT_FAILURE;
+    }
+
+    // Concatenate the segments, in order
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    for (auto& segment : segments) {
+        if (segment.head == nullptr) { continue; }
+
+        if (head == nullptr) {
+            head = segment.head;
+        }
+        else {
+            tail->next = segment.head;
+        }
+        tail = segment.tail;
+    }
+
+    auto built = Clock::now();
+
+    Hash hash = 0;
+
+    for (Node* node = head; node != nullptr; node = node->next) {
+        hash += node->hash();
+    }
+
+    std::cout << "list length = " << numBlocks << "  hash = "<< hash << std::endl;
+
+    std::chrono::duration<double> sizing = sized - start;
+    std::chrono::duration<double> building = built - sized;
+    std::cerr << "threads = " << numThreads
+        << "  sizes = " << sizing.count() << " s"
+        << "  build = " << building.count() << " s"
+        << "  (" << numBlocks / building.count() / 1e6 << " M nodes/s)\n";
+
+    for (auto& segment : segments) {
+        free(segment.arena);
+    }
+}
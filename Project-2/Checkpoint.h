@@ -0,0 +1,128 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Checkpoint.h ---
+//
+//  The saved state of an incremental computation of the mean of an
+//    append-only data file:  the number of values summed so far, their
+//    (compensated) sum, and the byte offset to resume from.  A later run
+//    then only needs to read the values appended since, making it
+//    proportional to the new data, rather than the whole file.
+//
+//  A checkpoint is only valid for the file it was taken from, so it also
+//    records the file's identity:  its device and inode numbers, and a
+//    checksum of its first few bytes (which catches a file that was
+//    rewritten in place, rather than appended to).  If those don't match,
+//    or the file has shrunk, the computation starts over.
+//
+//  Checkpoints are saved atomically, by writing a temporary file and
+//    renaming it over the old one, so an interrupted save never leaves a
+//    damaged checkpoint behind.
+//
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "DataFormat.h"
+
+struct Checkpoint {
+    static constexpr char   Magic[8] = "SSUCKPT";
+    static constexpr size_t HeadSize = 4096;  // bytes covered by headChecksum
+
+    char     magic[8] = {};
+    uint64_t count = 0;         // values summed so far
+    double   sum = 0.0;         //   their sum, and its compensation term
+    double   compensation = 0.0;
+    uint64_t offset = 0;        // byte offset of the next unread value
+    uint64_t device = 0;        // identity of the file
+    uint64_t inode = 0;
+    uint32_t headBytes = 0;     //   and a checksum of its first headBytes
+    uint32_t headChecksum = 0;  //   bytes
+
+    //-----------------------------------------------------------------------
+    //
+    // load() - read a checkpoint, returning an empty one if "path" doesn't
+    //   exist, or doesn't hold a checkpoint
+    //
+    static Checkpoint load(const std::string& path) {
+        Checkpoint checkpoint;
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return checkpoint; }
+
+        Checkpoint saved;
+        bool valid = ::read(fd, &saved, sizeof(saved)) == sizeof(saved)
+            && std::memcmp(saved.magic, Magic, sizeof(Magic)) == 0;
+        ::close(fd);
+
+        return valid ? saved : checkpoint;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // save() - write the checkpoint to "path", atomically replacing any
+    //   previous one
+    //
+    void save(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool saved = fd >= 0
+            && ::write(fd, this, sizeof(*this)) == sizeof(*this)
+            && ::fsync(fd) == 0;
+        if (fd >= 0) { saved = ::close(fd) == 0 && saved; }
+
+        if (!saved || ::rename(temporary.c_str(), path.c_str()) == -1) {
+            ::unlink(temporary.c_str());
+            std::stringstream error;
+            error << "Unable to save checkpoint '" << path << "'";
+            throw std::runtime_error(error.str());
+        }
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // identify() - record the identity of the file open as "fd" (with
+    //   status "info"), and matches() - check that it's still the same file
+    //
+    void identify(int fd, const struct stat& info) {
+        std::memcpy(magic, Magic, sizeof(Magic));
+        device = info.st_dev;
+        inode = info.st_ino;
+        headBytes = std::min<uint64_t>(HeadSize, offset);
+        head(fd, headBytes, headChecksum);
+    }
+
+    bool matches(int fd, const struct stat& info) const {
+        uint32_t crc;
+        return std::memcmp(magic, Magic, sizeof(Magic)) == 0
+            && device == uint64_t(info.st_dev)
+            && inode == uint64_t(info.st_ino)
+            && offset <= uint64_t(info.st_size)
+            && head(fd, headBytes, crc) && crc == headChecksum;
+    }
+
+  private:
+    // The checksum of the first numBytes bytes of the file
+    static bool head(int fd, size_t numBytes, uint32_t& crc) {
+        std::vector<char> bytes(numBytes);
+        if (::pread(fd, bytes.data(), numBytes, 0) != ssize_t(numBytes)) {
+            return false;
+        }
+        crc = DataFormat::checksum(bytes.data(), numBytes);
+        return true;
+    }
+};
+
+#endif // __CHECKPOINT_H__
@@ -0,0 +1,660 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Compressed.h ---
+//
+//  A compressed variant of our container format (see DataFormat.h), for
+//    data that's read from disk faster than it can be streamed, where
+//    trading some CPU time for fewer bytes pays off.  The file is laid
+//    out as
+//
+//      +--------------------+  offset 0
+//      | FileHeader         |  (with the CompressedMagic)
+//      +--------------------+  offset dataOffset (page aligned)
+//      | compressed block 0 |  each compressed independently, so blocks
+//      | compressed block 1 |    can be decoded in any order, in parallel
+//      | ...                |
+//      +--------------------+  offset summaryOffset
+//      | BlockSummary[]     |  one per block, of the uncompressed values
+//      +--------------------+
+//      | uint64_t[]         |  numBlocks + 1 byte offsets of the blocks,
+//      |                    |    relative to dataOffset
+//      +--------------------+
+//
+//  Each block starts with a byte giving its encoding:  either Stored (the
+//    raw values, for blocks that don't compress), or Packed, where the
+//    values' bits are
+//
+//    1. XOR-ed with the previous value's bits, which zeroes the bits
+//         neighboring values share (the sign, exponent, and leading
+//         mantissa bits of a slowly-varying series),
+//    2. byte shuffled, gathering the first bytes of all of the values,
+//         then the second bytes, and so on, so those zeros (and other
+//         repeated bytes) form long runs, and
+//    3. compressed with a small LZ77 coder (in the style of LZ4), which
+//         turns those runs into short back-references.
+//
+//  Decoding a block only needs two block-sized scratch buffers, so
+//    readers decode each block just before reducing it (see decode()),
+//    and a decompressed copy of the data is never materialized.
+//
+
+#ifndef __COMPRESSED_H__
+#define __COMPRESSED_H__
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "DataFormat.h"
+
+namespace Compression {
+
+enum Encoding : uint8_t {
+    Stored = 0,
+    Packed = 1
+};
+
+// The unsigned integer type with the same size as (and holding the bits of) T
+template <typename T>
+using Word = std::conditional_t<sizeof(T) == 2, uint16_t,
+    std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+
+//---------------------------------------------------------------------------
+//
+//  LZ coder.  The compressed data is a sequence of
+//
+//    token    - one byte:  the number of literals (high four bits), and
+//                 the match length minus MinMatch (low four bits), where
+//                 15 means more length bytes follow (each adding up to
+//                 255, and a byte less than 255 ending the length)
+//    literals - bytes copied directly to the output
+//    offset   - two bytes (little endian):  how far back the match starts
+//
+//  The final sequence has only literals, and ends the data.
+//
+
+const size_t MinMatch = 4;
+const size_t MaxOffset = 65535;
+const int    HashBits = 14;
+
+inline void compress(const uint8_t* in, size_t numBytes, std::vector<uint8_t>& out) {
+    std::vector<uint32_t> table(size_t(1) << HashBits, UINT32_MAX);
+    size_t anchor = 0;
+
+    auto length = [&](size_t n) {
+        for (; n >= 255; n -= 255) { out.push_back(255); }
+        out.push_back(n);
+    };
+
+    auto sequence = [&](size_t literalsEnd, size_t matchLength, size_t offset) {
+        size_t numLiterals = literalsEnd - anchor;
+        size_t extra = matchLength ? matchLength - MinMatch : 0;
+
+        out.push_back((std::min<size_t>(numLiterals, 15) << 4) | std::min<size_t>(extra, 15));
+        if (numLiterals >= 15) { length(numLiterals - 15); }
+        out.insert(out.end(), in + anchor, in + literalsEnd);
+
+        if (matchLength) {
+            out.push_back(offset & 0xff);
+            out.push_back(offset >> 8);
+            if (extra >= 15) { length(extra - 15); }
+        }
+    };
+
+    for (size_t i = 0; i + MinMatch <= numBytes; ) {
+        uint32_t bytes;
+        std::memcpy(&bytes, in + i, sizeof(bytes));
+        uint32_t hash = (bytes * 2654435761u) >> (32 - HashBits);
+
+        size_t candidate = table[hash];
+        table[hash] = i;
+
+        if (candidate != UINT32_MAX && i - candidate <= MaxOffset
+            && std::memcmp(in + candidate, in + i, MinMatch) == 0) {
+            size_t n = MinMatch;
+            while (i + n < numBytes && in[candidate + n] == in[i + n]) { ++n; }
+
+            sequence(i, n, i - candidate);
+            i += n;
+            anchor = i;
+        }
+        else {
+            // Skip ahead faster the longer we go without finding a match,
+            //   so incompressible data doesn't cost a hash per byte
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+
+    sequence(numBytes, 0, 0);
+}
+
+// Decompress exactly "outSize" bytes, throwing if the data's corrupted
+inline void decompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+    const uint8_t* end = in + inSize;
+    uint8_t* start = out;
+    uint8_t* outEnd = out + outSize;
+
+    auto fail = []() { throw std::runtime_error("Corrupted compressed block"); };
+
+    auto length = [&](size_t n) {
+        if (n == 15) {
+            uint8_t byte;
+            do {
+                if (in >= end) { fail(); }
+                byte = *in++;
+                n += byte;
+            } while (byte == 255);
+        }
+        return n;
+    };
+
+    while (true) {
+        if (in >= end) { fail(); }
+        uint8_t token = *in++;
+
+        size_t numLiterals = length(token >> 4);
+        if (numLiterals > size_t(end - in) || numLiterals > size_t(outEnd - out)) { fail(); }
+        std::memcpy(out, in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+
+        if (in == end) { break; }
+
+        if (end - in < 2) { fail(); }
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+
+        size_t n = length(token & 15) + MinMatch;
+        if (offset == 0 || offset > size_t(out - start) || n > size_t(outEnd - out)) {
+            fail();
+        }
+
+        const uint8_t* match = out - offset;
+        if (offset >= n) { std::memcpy(out, match, n); }
+        else { for (size_t i = 0; i < n; ++i) { out[i] = match[i]; } }
+        out += n;
+    }
+
+    if (out != outEnd) { fail(); }
+}
+
+//---------------------------------------------------------------------------
+//
+//  encode() - compress a block of values, appending it to "out"
+//
+
+template <typename T>
+void encode(const T* values, size_t count, std::vector<uint8_t>& out) {
+    using W = Word<T>;
+    const size_t numBytes = count * sizeof(T);
+
+    std::vector<uint8_t> shuffled(numBytes);
+    W previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        W word;
+        std::memcpy(&word, values + i, sizeof(word));
+        W delta = word ^ previous;
+        previous = word;
+
+        for (size_t b = 0; b < sizeof(W); ++b) {
+            shuffled[b * count + i] = uint8_t(delta >> (8 * b));
+        }
+    }
+
+    size_t start = out.size();
+    out.push_back(Packed);
+    compress(shuffled.data(), numBytes, out);
+
+    if (out.size() - start > numBytes) {
+        out.resize(start);
+        out.push_back(Stored);
+        auto bytes = reinterpret_cast<const uint8_t*>(values);
+        out.insert(out.end(), bytes, bytes + numBytes);
+    }
+}
+
+//---------------------------------------------------------------------------
+//
+//  Scratch - the per-thread buffers a block is decoded into
+//
+
+template <typename T>
+struct Scratch {
+    std::vector<uint8_t> bytes;
+    std::vector<T>       values;
+};
+
+template <typename T>
+const T* decode(const uint8_t* block, size_t numBytes, size_t count, Scratch<T>& scratch) {
+    using W = Word<T>;
+
+    if (numBytes < 1) { throw std::runtime_error("Corrupted compressed block"); }
+
+    scratch.values.resize(count);
+    T* values = scratch.values.data();
+
+    if (block[0] == Stored) {
+        if (numBytes - 1 != count * sizeof(T)) {
+            throw std::runtime_error("Corrupted compressed block");
+        }
+        std::memcpy(values, block + 1, count * sizeof(T));
+        return values;
+    }
+
+    scratch.bytes.resize(count * sizeof(T));
+    const uint8_t* shuffled = scratch.bytes.data();
+    decompress(block + 1, numBytes - 1, scratch.bytes.data(), scratch.bytes.size());
+
+    // Unshuffle, and undo the XOR-delta, in one pass
+    W previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        W delta = 0;
+        for (size_t b = 0; b < sizeof(W); ++b) {
+            delta |= W(shuffled[b * count + i]) << (8 * b);
+        }
+        previous ^= delta;
+        std::memcpy(values + i, &previous, sizeof(previous));
+    }
+
+    return values;
+}
+
+} // namespace Compression
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- CompressedWriter ---
+//
+//  Writes a compressed container in a single streaming pass, in the same
+//    way as DataWriter (see DataFormat.h)
+//
+
+template <typename Type>
+class CompressedWriter {
+
+    int                                   _fd;
+    std::string                           _path;
+    DataFormat::FileHeader                _header;
+    std::vector<Type>                     _block;
+    std::vector<DataFormat::BlockSummary> _summaries;
+    std::vector<uint64_t>                 _offsets{ 0 };
+    std::vector<uint8_t>                  _encoded;
+
+    void writeAll(const void* data, size_t numBytes, off_t offset) {
+        auto bytes = static_cast<const char*>(data);
+        while (numBytes > 0) {
+            ssize_t n = pwrite(_fd, bytes, numBytes, offset);
+            if (n < 0) {
+                std::stringstream error;
+                error << "Unable to write() file '" << _path << "'";
+                throw std::runtime_error(error.str());
+            }
+            bytes += n;
+            offset += n;
+            numBytes -= n;
+        }
+    }
+
+    void flushBlock() {
+        if (_block.empty()) { return; }
+
+        DataFormat::Aggregate aggregate;
+        aggregate.add(_block.data(), _block.data() + _block.size());
+
+        DataFormat::BlockSummary summary = {};
+        summary.count = aggregate.count;
+        summary.sum = aggregate.sum;
+        summary.min = aggregate.min;
+        summary.max = aggregate.max;
+        summary.checksum = DataFormat::checksum(_block.data(), _block.size() * sizeof(Type));
+
+        _encoded.clear();
+        Compression::encode(_block.data(), _block.size(), _encoded);
+        writeAll(_encoded.data(), _encoded.size(), _header.dataOffset + _offsets.back());
+
+        _offsets.push_back(_offsets.back() + _encoded.size());
+        _header.count += _block.size();
+        _summaries.push_back(summary);
+        _block.clear();
+    }
+
+  public:
+    CompressedWriter(const char* path, const char* name = "value",
+        size_t blockSize = DataFormat::DefaultBlockSize) : _path(path)
+    {
+        _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0) {
+            std::stringstream error;
+            error << "Unable to open() file '" << path << "' for writing";
+            throw std::runtime_error(error.str());
+        }
+
+        _header = {};
+        std::memcpy(_header.magic, DataFormat::CompressedMagic, sizeof(_header.magic));
+        _header.version = DataFormat::Version;
+        _header.byteOrder = DataFormat::ByteOrderMark;
+        _header.type = DataFormat::TypeCode<Type>::value;
+        _header.elementSize = sizeof(Type);
+        std::strncpy(_header.name, name, sizeof(_header.name) - 1);
+        _header.blockSize = std::max<size_t>(1, blockSize);
+        _header.dataOffset = DataFormat::Alignment;
+
+        _block.reserve(_header.blockSize);
+    }
+
+    CompressedWriter(const CompressedWriter&) = delete;
+    CompressedWriter& operator=(const CompressedWriter&) = delete;
+
+    ~CompressedWriter() {
+        if (_fd >= 0) {
+            try { close(); } catch (...) { /* nothing we can do here */ }
+        }
+    }
+
+    void write(const Type* values, size_t count) {
+        while (count > 0) {
+            size_t n = std::min(count, _header.blockSize - _block.size());
+            _block.insert(_block.end(), values, values + n);
+            values += n;
+            count -= n;
+
+            if (_block.size() == _header.blockSize) { flushBlock(); }
+        }
+    }
+
+    void close() {
+        flushBlock();
+
+        _header.numBlocks = _summaries.size();
+        _header.summaryOffset = _header.dataOffset + _offsets.back();
+        _header.summaryOffset = (_header.summaryOffset + 7) / 8 * 8;
+        _header.headerChecksum = DataFormat::checksum(_header);
+
+        size_t summaryBytes = _summaries.size() * sizeof(DataFormat::BlockSummary);
+        writeAll(_summaries.data(), summaryBytes, _header.summaryOffset);
+        writeAll(_offsets.data(), _offsets.size() * sizeof(uint64_t),
+            _header.summaryOffset + summaryBytes);
+        writeAll(&_header, sizeof(_header), 0);
+
+        ::close(_fd);
+        _fd = -1;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- CompressedData ---
+//
+//  Read access to a compressed container.  Like the Data class, the file
+//    is memory mapped, but as the values have to be decoded, access is
+//    either
+//
+//    * a block at a time, using decode() with a Scratch buffer (one per
+//        thread), which is how parallel readers should use it, or
+//    * sequentially, using the (input) iterators from begin() and end(),
+//        which decode each block as they reach it.
+//
+
+template <typename Type>
+class CompressedData {
+
+    int    _fd;
+    void*  _memory;
+    size_t _bytes;
+    const DataFormat::FileHeader*   _header;
+    const DataFormat::BlockSummary* _summaries;
+    const uint64_t*                 _offsets;
+    const uint8_t*                  _blocks;
+
+  public:
+    using Scratch = Compression::Scratch<Type>;
+
+    // Is the file at "path" a compressed container?
+    static bool isCompressed(const std::string& path) {
+        char magic[sizeof(DataFormat::CompressedMagic)];
+        int fd = open(path.c_str(), O_RDONLY);
+        bool compressed = fd >= 0 && read(fd, magic, sizeof(magic)) == sizeof(magic)
+            && std::memcmp(magic, DataFormat::CompressedMagic, sizeof(magic)) == 0;
+        if (fd >= 0) { close(fd); }
+        return compressed;
+    }
+
+    CompressedData(const char* path) {
+        _fd = open(path, O_RDONLY);
+        if (_fd < 0) {
+            std::stringstream error;
+            error << "Unable to open() file '" << path << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        struct stat stat;
+        if (fstat(_fd, &stat) == -1) {
+            std::stringstream error;
+            error << "Unable to stat() file '" << path << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        _bytes = stat.st_size;
+
+        _memory = mmap(NULL, _bytes, PROT_READ, MAP_SHARED, _fd, 0);
+        if (_memory == MAP_FAILED) {
+            std::stringstream error;
+            error << "Unable to mmap() file '" << path << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        const char* bytes = static_cast<const char*>(_memory);
+        _header = static_cast<const DataFormat::FileHeader*>(_memory);
+
+        if (_bytes < sizeof(DataFormat::FileHeader) || std::memcmp(_header->magic,
+                DataFormat::CompressedMagic, sizeof(_header->magic)) != 0) {
+            std::stringstream error;
+            error << "File '" << path << "' is not a compressed container";
+            throw std::runtime_error(error.str());
+        }
+
+        DataFormat::validateHeader<Type>(*_header, path);
+
+        auto inconsistent = [&]() {
+            std::stringstream error;
+            error << "File '" << path << "' is truncated, or has an inconsistent layout";
+            throw std::runtime_error(error.str());
+        };
+
+        // (blockCount is checked first, so the sizes below can't overflow)
+        const size_t blockCount = _header->numBlocks;
+        if (blockCount >= _bytes / sizeof(uint64_t)
+            || _header->dataOffset > _header->summaryOffset
+            || _header->summaryOffset > _bytes) {
+            inconsistent();
+        }
+
+        size_t summaryBytes = blockCount * sizeof(DataFormat::BlockSummary);
+        size_t offsetBytes = (blockCount + 1) * sizeof(uint64_t);
+        if (summaryBytes + offsetBytes > _bytes - _header->summaryOffset) {
+            inconsistent();
+        }
+
+        _summaries = reinterpret_cast<const DataFormat::BlockSummary*>(
+            bytes + _header->summaryOffset);
+        _offsets = reinterpret_cast<const uint64_t*>(
+            bytes + _header->summaryOffset + summaryBytes);
+        _blocks = reinterpret_cast<const uint8_t*>(bytes + _header->dataOffset);
+
+        // Each block has to start after the previous one, and the last one
+        //   has to end before the summaries.  Only the final block may be
+        //   short, and the blocks' counts have to add up to the header's.
+        const size_t dataBytes = _header->summaryOffset - _header->dataOffset;
+        if (_offsets[0] != 0 || _offsets[blockCount] > dataBytes) { inconsistent(); }
+
+        uint64_t count = 0;
+        for (size_t block = 0; block < blockCount; ++block) {
+            uint64_t n = _summaries[block].count;
+            if (_offsets[block + 1] <= _offsets[block] || n > _header->blockSize
+                || (n < _header->blockSize && block + 1 < blockCount)) {
+                inconsistent();
+            }
+            count += n;
+        }
+        if (count != _header->count) { inconsistent(); }
+    }
+
+    CompressedData(const CompressedData&) = delete;
+    CompressedData& operator=(const CompressedData&) = delete;
+
+    ~CompressedData() {
+        munmap(_memory, _bytes);
+        close(_fd);
+    }
+
+    size_t size() const
+        { return _header->count; }
+
+    size_t blockSize() const
+        { return _header->blockSize; }
+
+    size_t numBlocks() const
+        { return _header->numBlocks; }
+
+    // The compressed size of the data (not including the header and
+    //   summaries)
+    size_t compressedSize() const
+        { return _offsets[numBlocks()]; }
+
+    bool hasSummaries() const
+        { return true; }
+
+    const DataFormat::BlockSummary* summaries() const
+        { return _summaries; }
+
+    //-----------------------------------------------------------------------
+    //
+    // aggregate() - as Data::aggregate(), the count, sum, min, and max of
+    //   the values with indices in [begin, end).  Blocks entirely inside the
+    //   range are taken from their summaries, and only the (at most two)
+    //   blocks partially covered by it are decoded.
+    //
+    DataFormat::Aggregate aggregate(size_t begin, size_t end) const {
+        DataFormat::Aggregate result;
+        Scratch scratch;
+
+        end = std::min(end, size());
+        if (begin >= end) { return result; }
+
+        for (size_t block = begin / blockSize(); block < numBlocks(); ++block) {
+            size_t first = block * blockSize();
+            size_t last = first + _summaries[block].count;
+            if (first >= end) { break; }
+
+            if (begin <= first && last <= end) {
+                result += _summaries[block];
+            }
+            else {
+                const Type* values = decode(block, scratch).first;
+                result.add(values + (std::max(begin, first) - first),
+                    values + (std::min(end, last) - first));
+            }
+        }
+
+        return result;
+    }
+
+    DataFormat::Aggregate aggregate() const
+        { return aggregate(0, size()); }
+
+    //-----------------------------------------------------------------------
+    //
+    // decode() - decode a block into "scratch", returning the range of its
+    //   values (which stay valid until the scratch is reused)
+    //
+    std::pair<const Type*, const Type*> decode(size_t block, Scratch& scratch) const {
+        size_t count = _summaries[block].count;
+        const Type* values = Compression::decode(_blocks + _offsets[block],
+            _offsets[block + 1] - _offsets[block], count, scratch);
+        return { values, values + count };
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // verify() - decode each block, and check it against its checksum.
+    //   Returns the index of the first corrupted block, or numBlocks() if
+    //   all are intact.
+    //
+    size_t verify() const {
+        Scratch scratch;
+        for (size_t block = 0; block < numBlocks(); ++block) {
+            try {
+                auto [begin, end] = decode(block, scratch);
+                size_t numBytes = (end - begin) * sizeof(Type);
+                if (DataFormat::checksum(begin, numBytes) != _summaries[block].checksum) {
+                    return block;
+                }
+            }
+            catch (const std::runtime_error&) {
+                return block;
+            }
+        }
+
+        return numBlocks();
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Sequential iteration over the values
+    //
+    class iterator {
+        const CompressedData*    _data = nullptr;
+        size_t                   _index = 0;
+        std::shared_ptr<Scratch> _scratch;
+        const Type*              _values = nullptr;
+        size_t                   _block = SIZE_MAX;
+
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Type*;
+        using reference = const Type&;
+
+        iterator() = default;
+
+        iterator(const CompressedData* data, size_t index)
+            : _data(data), _index(index), _scratch(std::make_shared<Scratch>()) {}
+
+        reference operator*() {
+            size_t block = _index / _data->blockSize();
+            if (block != _block) {
+                _values = _data->decode(block, *_scratch).first;
+                _block = block;
+            }
+            return _values[_index - block * _data->blockSize()];
+        }
+
+        iterator& operator++()
+            { ++_index; return *this; }
+
+        bool operator==(const iterator& i) const
+            { return _index == i._index; }
+    };
+
+    iterator begin() const
+        { return iterator(this, 0); }
+
+    iterator end() const
+        { return iterator(this, size()); }
+};
+
+#endif // __COMPRESSED_H__
@@ -12,6 +12,12 @@
 //    (e.g., begin(), end(), etc.).  It is not a fully-implemented
 //    container, but suffices for our purposes.
 //
+//  Files may either be a raw array of values, or a self-describing
+//    container (see DataFormat.h), which is recognized by its header.  For
+//    containers, the indexing interface only covers the data values, and
+//    aggregates (sum, min, max) are computed from the per-block summaries
+//    wherever possible.
+//
 
 #ifndef __DATA_H__
 #define __DATA_H__
@@ -21,9 +27,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <cstring>
 #include <sstream>
 #include <string>
 
+#include "DataFormat.h"
+
 template <typename Type>
 class Data {
 
@@ -31,6 +40,13 @@ class Data {
     size_t _size;
     const Type*  _data;
 
+    // The entire mapped file, and (for containers) its header and
+    //   block summaries
+    void*  _memory;
+    size_t _bytes;
+    const DataFormat::FileHeader*   _header = nullptr;
+    const DataFormat::BlockSummary* _summaries = nullptr;
+
   public:
     Data(const char* path) {
         _fd = open(path, O_RDONLY);
@@ -47,17 +63,36 @@ class Data {
             throw std::runtime_error(error.str());
         }
         
-        _size = stat.st_size;
+        _bytes = stat.st_size;
 
-        void* memory = mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
-        if (memory == MAP_FAILED) {
+        _memory = mmap(NULL, _bytes, PROT_READ, MAP_SHARED, _fd, 0);
+        if (_memory == MAP_FAILED) {
             std::stringstream error;
             error << "Unable to mmap() file '" << path << "'";
             throw std::runtime_error(error.str());
         }
 
-        _data = static_cast<const Type*>(memory);
-        _size /= sizeof(Type);
+        const char* bytes = static_cast<const char*>(_memory);
+
+        if (_bytes >= sizeof(DataFormat::CompressedMagic) && std::memcmp(_memory,
+                DataFormat::CompressedMagic, sizeof(DataFormat::CompressedMagic)) == 0) {
+            std::stringstream error;
+            error << "File '" << path << "' is a compressed container;  "
+                "read it with CompressedData (see Compressed.h)";
+            throw std::runtime_error(error.str());
+        }
+
+        if (DataFormat::isContainer(_memory, _bytes)) {
+            _header = &DataFormat::validate<Type>(_memory, _bytes, path);
+            _summaries = reinterpret_cast<const DataFormat::BlockSummary*>(
+                bytes + _header->summaryOffset);
+            _data = reinterpret_cast<const Type*>(bytes + _header->dataOffset);
+            _size = _header->count;
+        }
+        else {
+            _data = static_cast<const Type*>(_memory);
+            _size = _bytes / sizeof(Type);
+        }
     }
 
     Data(const Data&) = delete;
@@ -66,7 +101,7 @@ class Data {
     Data& operator=(Data&&) = delete;
 
     ~Data() {
-        munmap((void*) _data, _size * sizeof(Type));
+        munmap(_memory, _bytes);
         close(_fd);
     }
 
@@ -85,6 +120,89 @@ class Data {
     const Type& operator[] (size_t index) const {
         return _data[index];
     }
+
+    //-----------------------------------------------------------------------
+    //
+    // Block summaries (only available for container files)
+    //
+
+    bool hasSummaries() const
+        { return _header != nullptr; }
+
+    size_t blockSize() const
+        { return _header ? _header->blockSize : _size; }
+
+    size_t numBlocks() const
+        { return _header ? _header->numBlocks : 0; }
+
+    const DataFormat::BlockSummary* summaries() const
+        { return _summaries; }
+
+    // Application-defined metadata stored with the header (if any)
+    const void* metadata() const
+        { return _header ? _header + 1 : nullptr; }
+
+    size_t metadataSize() const
+        { return _header ? _header->metadataSize : 0; }
+
+    //-----------------------------------------------------------------------
+    //
+    // aggregate() - the count, sum, min, and max of the values with indices
+    //   in [begin, end).  For containers, blocks entirely inside the range
+    //   are taken from their summaries, so only the (at most two) blocks
+    //   partially covered by the range have their values read.
+    //
+
+    DataFormat::Aggregate aggregate(size_t begin, size_t end) const {
+        DataFormat::Aggregate result;
+
+        end = std::min(end, _size);
+        if (begin >= end) { return result; }
+
+        if (!_header) {
+            result.add(_data + begin, _data + end);
+            return result;
+        }
+
+        size_t blockSize = _header->blockSize;
+        size_t first = (begin + blockSize - 1) / blockSize;  // first full block
+        size_t last = end / blockSize;                        // one past the last
+        if (end == _size) { last = _header->numBlocks; }
+
+        if (first >= last) {
+            result.add(_data + begin, _data + end);
+            return result;
+        }
+
+        result.add(_data + begin, _data + first * blockSize);
+        for (size_t block = first; block < last; ++block) {
+            result += _summaries[block];
+        }
+        result.add(_data + std::min(end, last * blockSize), _data + end);
+
+        return result;
+    }
+
+    DataFormat::Aggregate aggregate() const
+        { return aggregate(0, _size); }
+
+    //-----------------------------------------------------------------------
+    //
+    // verify() - check each block's data against its checksum.  Returns the
+    //   index of the first corrupted block, or numBlocks() if all are intact.
+    //
+
+    size_t verify() const {
+        for (size_t block = 0; block < numBlocks(); ++block) {
+            const Type* start = _data + block * _header->blockSize;
+            size_t numBytes = _summaries[block].count * sizeof(Type);
+            if (DataFormat::checksum(start, numBytes) != _summaries[block].checksum) {
+                return block;
+            }
+        }
+
+        return numBlocks();
+    }
 };
 
 #endif // __DATA_H__
\ No newline at end of file
@@ -0,0 +1,436 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- DataFormat.h ---
+//
+//  A self-describing container format for our data files, which the Data
+//    class (see Data.h) opens transparently in place of a raw, headerless
+//    array.  A file is laid out as
+//
+//      +--------------------+  offset 0
+//      | FileHeader         |  magic, version, byte order, schema, layout
+//      | metadata           |  optional, application-defined
+//      +--------------------+  offset dataOffset (page aligned)
+//      | block 0            |  blockSize elements each, except possibly
+//      | block 1            |    the last one
+//      | ...                |
+//      +--------------------+  offset summaryOffset
+//      | BlockSummary[]     |  one per block:  count, sum, min, max, and a
+//      |                    |    checksum of the block's bytes
+//      +--------------------+
+//
+//  The data is stored in the machine's native byte order, so it can be
+//    memory mapped and used directly;  opening a file written on a machine
+//    of the other byte order is reported as an error rather than silently
+//    producing garbage.
+//
+//  The per-block summaries (sometimes called "zone maps") let aggregates
+//    over the whole file, or over a range of it, be computed mostly from
+//    the summaries, only touching the data for blocks partially covered
+//    by a range (see Data<T>::aggregate()).
+//
+//  The summaries are written after the data so that files can be written
+//    in a single streaming pass (see DataWriter).
+//
+
+#ifndef __DATAFORMAT_H__
+#define __DATAFORMAT_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace DataFormat {
+
+const char     Magic[8] = { 'S', 'S', 'U', 'D', 'A', 'T', 'A', '\0' };
+const char     CompressedMagic[8] = { 'S', 'S', 'U', 'Z', 'D', 'A', 'T', 'A' };  // see Compressed.h
+const uint32_t Version = 1;
+const uint32_t ByteOrderMark = 0x01020304;
+const uint64_t Alignment = 4096;
+const uint64_t DefaultBlockSize = 65536;
+
+//---------------------------------------------------------------------------
+//
+//  Schema:  the type of the elements stored in a file.  TypeCode<T>::value
+//    maps a C++ type to its code, and is only defined for supported types.
+//
+
+enum Type : uint32_t {
+    Float32 = 1,
+    Float64 = 2,
+    Int32   = 3,
+    Int64   = 4,
+    Float16  = 5,   // see Half.h
+    BFloat16 = 6,
+
+    // Compound types used by our own sidecar files
+    PrefixSum = 16   // see PrefixIndex.h
+};
+
+template <typename T> struct TypeCode;
+template <> struct TypeCode<float>   { static constexpr Type value = Float32; };
+template <> struct TypeCode<double>  { static constexpr Type value = Float64; };
+template <> struct TypeCode<int32_t> { static constexpr Type value = Int32; };
+template <> struct TypeCode<int64_t> { static constexpr Type value = Int64; };
+
+inline const char* typeName(uint32_t type) {
+    switch (type) {
+        case Float32:   return "float32";
+        case Float64:   return "float64";
+        case Int32:     return "int32";
+        case Int64:     return "int64";
+        case Float16:   return "float16";
+        case BFloat16:  return "bfloat16";
+        case PrefixSum: return "prefix-sum";
+        default:        return "unknown";
+    }
+}
+
+//---------------------------------------------------------------------------
+//
+//  File structures
+//
+
+struct FileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t type;           // schema:  element type (see Type)
+    uint32_t elementSize;    //   its size in bytes
+    char     name[32];       //   and a name for the values (e.g., "temperature")
+    uint64_t count;          // number of elements
+    uint64_t blockSize;      // elements per block
+    uint64_t numBlocks;
+    uint64_t dataOffset;     // byte offset of the first block
+    uint64_t summaryOffset;  // byte offset of the BlockSummary array
+    uint32_t headerChecksum; // checksum of the header, with this field zero
+    uint32_t metadataSize;   // bytes of metadata following the header
+};
+
+// Space available for metadata between the header and the data
+const size_t MaxMetadataSize = Alignment - sizeof(FileHeader);
+
+struct BlockSummary {
+    uint64_t count;
+    double   sum;
+    double   min;
+    double   max;
+    uint32_t checksum;       // checksum of the block's bytes
+    uint32_t reserved;
+};
+
+//---------------------------------------------------------------------------
+//
+//  Aggregate - the count, sum, and extremes of a collection of values,
+//    which can be merged together
+//
+
+struct Aggregate {
+    uint64_t count = 0;
+    double   sum = 0.0;
+    double   min = std::numeric_limits<double>::infinity();
+    double   max = -std::numeric_limits<double>::infinity();
+
+    double mean() const
+        { return count ? sum / count : 0.0; }
+
+    template <typename T>
+    void add(const T* begin, const T* end) {
+        for (auto p = begin; p != end; ++p) {
+            double value = *p;
+            sum += value;
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        count += end - begin;
+    }
+
+    Aggregate& operator += (const Aggregate& a) {
+        count += a.count;
+        sum += a.sum;
+        min = std::min(min, a.min);
+        max = std::max(max, a.max);
+        return *this;
+    }
+
+    Aggregate& operator += (const BlockSummary& s) {
+        count += s.count;
+        sum += s.sum;
+        min = std::min(min, s.min);
+        max = std::max(max, s.max);
+        return *this;
+    }
+};
+
+//---------------------------------------------------------------------------
+//
+//  checksum() - CRC-32C (Castagnoli), computed eight bytes at a time using
+//    the "slicing-by-8" tables
+//
+
+inline uint32_t checksum(const void* data, size_t numBytes, uint32_t crc = 0) {
+    static const auto tables = [] {
+        std::vector<uint32_t> t(8 * 256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) { c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1))); }
+            t[i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) {
+                t[s * 256 + i] = (t[(s - 1) * 256 + i] >> 8) ^ t[t[(s - 1) * 256 + i] & 0xFF];
+            }
+        }
+        return t;
+    }();
+
+    const uint32_t* t = tables.data();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+
+    for (; numBytes >= 8; numBytes -= 8, p += 8) {
+        uint32_t lo;
+        uint32_t hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+
+        crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)]
+            ^ t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)]
+            ^ t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + ((hi >> 8) & 0xFF)]
+            ^ t[1 * 256 + ((hi >> 16) & 0xFF)] ^ t[0 * 256 + (hi >> 24)];
+    }
+
+    for (; numBytes > 0; --numBytes, ++p) {
+        crc = (crc >> 8) ^ t[(crc ^ *p) & 0xFF];
+    }
+
+    return ~crc;
+}
+
+inline uint32_t checksum(FileHeader header) {
+    header.headerChecksum = 0;
+    return checksum(&header, sizeof(header));
+}
+
+//---------------------------------------------------------------------------
+//
+//  isContainer() - does the mapped file start with our header?
+//
+
+inline bool isContainer(const void* memory, size_t numBytes) {
+    return numBytes >= sizeof(FileHeader)
+        && std::memcmp(memory, Magic, sizeof(Magic)) == 0;
+}
+
+//---------------------------------------------------------------------------
+//
+//  elementType() - the element type recorded in the header of the file at
+//    "path" (a container, or a compressed container), or "type" for files
+//    without one (i.e., raw files, whose type has to be given)
+//
+
+inline uint32_t elementType(const std::string& path, uint32_t type) {
+    FileHeader header;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return type; }
+
+    if (read(fd, &header, sizeof(header)) == sizeof(header)
+        && (std::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+            || std::memcmp(header.magic, CompressedMagic, sizeof(CompressedMagic)) == 0)) {
+        type = header.type;
+    }
+    close(fd);
+
+    return type;
+}
+
+//---------------------------------------------------------------------------
+//
+//  validate() - verify a container's header is well-formed, and describes
+//    data of type T.  Throws a std::runtime_error if not.  validateHeader()
+//    checks only the header itself (and not the file's layout, which
+//    depends on how the data's stored;  see Compressed.h).
+//
+
+template <typename T>
+void validateHeader(const FileHeader& header, const char* path) {
+    auto fail = [&](const std::string& reason) {
+        std::stringstream error;
+        error << "File '" << path << "' " << reason;
+        throw std::runtime_error(error.str());
+    };
+
+    if (header.byteOrder != ByteOrderMark) {
+        fail("was written with a different byte order");
+    }
+    if (header.version != Version) {
+        fail("has unsupported format version " + std::to_string(header.version));
+    }
+    if (header.headerChecksum != checksum(header)) {
+        fail("has a corrupted header");
+    }
+    if (header.type != TypeCode<T>::value || header.elementSize != sizeof(T)) {
+        fail(std::string("contains ") + typeName(header.type) + " values, not "
+            + typeName(TypeCode<T>::value));
+    }
+    if (header.blockSize == 0 || header.metadataSize > MaxMetadataSize
+        || header.numBlocks != (header.count + header.blockSize - 1) / header.blockSize) {
+        fail("has an inconsistent layout");
+    }
+}
+
+template <typename T>
+const FileHeader& validate(const void* memory, size_t numBytes, const char* path) {
+    const FileHeader& header = *static_cast<const FileHeader*>(memory);
+
+    validateHeader<T>(header, path);
+
+    if (header.dataOffset + header.count * sizeof(T) > header.summaryOffset
+        || header.summaryOffset + header.numBlocks * sizeof(BlockSummary) > numBytes) {
+        std::stringstream error;
+        error << "File '" << path << "' is truncated, or has an inconsistent layout";
+        throw std::runtime_error(error.str());
+    }
+
+    return header;
+}
+
+} // namespace DataFormat
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- DataWriter ---
+//
+//  Writes a container file in a single streaming pass:  values are
+//    buffered into blocks, each block is summarized and written as it
+//    fills, and the summaries and (final) header are written by close()
+//    (or the destructor).
+//
+
+template <typename Type>
+class DataWriter {
+
+    int                                   _fd;
+    std::string                           _path;
+    DataFormat::FileHeader                _header;
+    std::vector<Type>                     _block;
+    std::vector<DataFormat::BlockSummary> _summaries;
+
+    void writeAll(const void* data, size_t numBytes, off_t offset) {
+        auto bytes = static_cast<const char*>(data);
+        while (numBytes > 0) {
+            ssize_t n = pwrite(_fd, bytes, numBytes, offset);
+            if (n < 0) {
+                std::stringstream error;
+                error << "Unable to write() file '" << _path << "'";
+                throw std::runtime_error(error.str());
+            }
+            bytes += n;
+            offset += n;
+            numBytes -= n;
+        }
+    }
+
+    void flushBlock() {
+        if (_block.empty()) { return; }
+
+        DataFormat::Aggregate aggregate;
+        aggregate.add(_block.data(), _block.data() + _block.size());
+
+        size_t numBytes = _block.size() * sizeof(Type);
+        DataFormat::BlockSummary summary = {};
+        summary.count = aggregate.count;
+        summary.sum = aggregate.sum;
+        summary.min = aggregate.min;
+        summary.max = aggregate.max;
+        summary.checksum = DataFormat::checksum(_block.data(), numBytes);
+
+        writeAll(_block.data(), numBytes,
+            _header.dataOffset + _header.count * sizeof(Type));
+
+        _header.count += _block.size();
+        _summaries.push_back(summary);
+        _block.clear();
+    }
+
+  public:
+    DataWriter(const char* path, const char* name = "value",
+        size_t blockSize = DataFormat::DefaultBlockSize) : _path(path)
+    {
+        _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0) {
+            std::stringstream error;
+            error << "Unable to open() file '" << path << "' for writing";
+            throw std::runtime_error(error.str());
+        }
+
+        _header = {};
+        std::memcpy(_header.magic, DataFormat::Magic, sizeof(_header.magic));
+        _header.version = DataFormat::Version;
+        _header.byteOrder = DataFormat::ByteOrderMark;
+        _header.type = DataFormat::TypeCode<Type>::value;
+        _header.elementSize = sizeof(Type);
+        std::strncpy(_header.name, name, sizeof(_header.name) - 1);
+        _header.blockSize = std::max<size_t>(1, blockSize);
+        _header.dataOffset = DataFormat::Alignment;
+
+        _block.reserve(_header.blockSize);
+    }
+
+    DataWriter(const DataWriter&) = delete;
+    DataWriter& operator=(const DataWriter&) = delete;
+
+    ~DataWriter() {
+        if (_fd >= 0) {
+            try { close(); } catch (...) { /* nothing we can do here */ }
+        }
+    }
+
+    void write(const Type* values, size_t count) {
+        while (count > 0) {
+            size_t n = std::min(count, _header.blockSize - _block.size());
+            _block.insert(_block.end(), values, values + n);
+            values += n;
+            count -= n;
+
+            if (_block.size() == _header.blockSize) { flushBlock(); }
+        }
+    }
+
+    // Store application-defined metadata (at most MaxMetadataSize bytes)
+    //   along with the header
+    void setMetadata(const void* metadata, size_t numBytes) {
+        if (numBytes > DataFormat::MaxMetadataSize) {
+            throw std::length_error("Container metadata is too large");
+        }
+
+        writeAll(metadata, numBytes, sizeof(_header));
+        _header.metadataSize = numBytes;
+    }
+
+    void close() {
+        flushBlock();
+
+        _header.numBlocks = _summaries.size();
+        _header.summaryOffset = _header.dataOffset + _header.count * sizeof(Type);
+        _header.summaryOffset = (_header.summaryOffset + 7) / 8 * 8;
+        _header.headerChecksum = DataFormat::checksum(_header);
+
+        writeAll(_summaries.data(), _summaries.size() * sizeof(DataFormat::BlockSummary),
+            _header.summaryOffset);
+        writeAll(&_header, sizeof(_header), 0);
+
+        ::close(_fd);
+        _fd = -1;
+    }
+};
+
+#endif // __DATAFORMAT_H__
@@ -0,0 +1,339 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Dataset.h ---
+//
+//  A C++ class presenting a collection of data files ("shards") as one
+//    logical sequence of values.  A dataset is named by either a
+//    directory (the regular files in it, other than hidden files and our
+//    sidecar files;  see isSidecar()), or a glob(3) pattern (e.g.,
+//    "logs/day-*.bin");  a single filename is a dataset with one shard.
+//    Shards are ordered by name, and each may be a raw file, a container
+//    (see DataFormat.h), or a compressed container (see Compressed.h).
+//
+//  Shards vary in size, so rather than dividing the shards among the
+//    threads, the dataset is divided into work units of (at most)
+//    UnitBytes bytes (or, for compressed shards, one block), which never
+//    span shards.  Threads claim units, in order, from an atomic counter
+//    until they run out, keeping them balanced regardless of how the
+//    values are spread over the shards.
+//
+//  Mapping every shard at once could exhaust the process's file
+//    descriptors or memory mappings, so shards are mapped on demand
+//    through a small cache, which unmaps the least recently used shards
+//    not currently in use once more than maxOpen are mapped.  Each thread
+//    reads its units through a Reader, which holds on to its current
+//    shard, and the scratch space for decoding compressed blocks.
+//
+
+#ifndef __DATASET_H__
+#define __DATASET_H__
+
+#include <glob.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Compressed.h"
+#include "Data.h"
+#include "DataFormat.h"
+
+template <typename Type>
+class Dataset {
+
+  public:
+    static constexpr size_t UnitBytes = 4 << 20;
+    static constexpr size_t DefaultMaxOpen = 64;
+
+    // A range of values [begin, end) within one shard
+    struct Unit {
+        size_t shard;
+        size_t begin;
+        size_t end;
+    };
+
+  private:
+    struct Shard {
+        std::string path;
+        size_t      size;    // number of values
+        DataFormat::Aggregate aggregate;   // (only if hasSummaries)
+        bool        hasSummaries;
+        bool        compressed;
+    };
+
+    // A mapped shard, of either kind
+    struct Mapping {
+        std::shared_ptr<const Data<Type>>           data;
+        std::shared_ptr<const CompressedData<Type>> compressed;
+
+        long useCount() const
+            { return data ? data.use_count() : compressed.use_count(); }
+    };
+
+  public:
+    // The per-thread state for reading units (see read())
+    struct Reader {
+        size_t                                shard = SIZE_MAX;
+        Mapping                               mapping;
+        typename CompressedData<Type>::Scratch scratch;
+    };
+
+  private:
+    std::vector<Shard>  _shards;
+    std::vector<Unit>   _units;
+    size_t              _size = 0;
+    size_t              _maxOpen;
+
+    // The cache of mapped shards, and their use, most recent first
+    std::mutex          _mutex;
+    std::vector<Mapping> _mapped;
+    std::list<size_t>   _recent;
+
+  public:
+    //-----------------------------------------------------------------------
+    //
+    // isSidecar() - is the file "name" (at "path") one the programs keep
+    //   alongside a data file, rather than data:  a prefix-sum index (see
+    //   PrefixIndex.h), a checkpoint (see Checkpoint.h), or the temporary
+    //   file either is written to before being renamed into place
+    //
+    static bool isSidecar(const std::string& path, const std::string& name) {
+        auto endsWith = [&](const std::string& suffix) {
+            return name.size() >= suffix.size()
+                && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+
+        if (endsWith(".psum") || endsWith(".tmp")
+            || name.find(".tmp.") != std::string::npos) {
+            return true;
+        }
+
+        char magic[sizeof(Checkpoint::Magic)];
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return false; }
+        bool checkpoint = ::read(fd, magic, sizeof(magic)) == sizeof(magic)
+            && std::memcmp(magic, Checkpoint::Magic, sizeof(magic)) == 0;
+        ::close(fd);
+
+        return checkpoint
+            || DataFormat::elementType(path, DataFormat::Float32) == DataFormat::PrefixSum;
+    }
+
+    // The paths of the shards named by "pattern" (in order)
+    static std::vector<std::string> list(const std::string& pattern) {
+        std::vector<std::string> paths;
+
+        struct stat info;
+        if (stat(pattern.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            DIR* dir = opendir(pattern.c_str());
+            for (dirent* entry; dir && (entry = readdir(dir)); ) {
+                std::string name = entry->d_name;
+                std::string path = pattern + "/" + name;
+                if (name[0] != '.' && stat(path.c_str(), &info) == 0
+                    && S_ISREG(info.st_mode) && !isSidecar(path, name)) {
+                    paths.push_back(path);
+                }
+            }
+            if (dir) { closedir(dir); }
+            std::sort(paths.begin(), paths.end());
+        }
+        else {
+            glob_t matches;
+            if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+                for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                    paths.push_back(matches.gl_pathv[i]);
+                }
+            }
+            globfree(&matches);
+        }
+
+        if (paths.empty()) {
+            std::stringstream error;
+            error << "No data files match '" << pattern << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        return paths;
+    }
+
+    // The type of the values in the shards at "paths" (see
+    //   DataFormat::elementType()), taken from the first that isn't empty
+    static uint32_t elementType(const std::vector<std::string>& paths, uint32_t type) {
+        for (auto& path : paths) {
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0 && info.st_size > 0) {
+                return DataFormat::elementType(path, type);
+            }
+        }
+        return type;
+    }
+
+    Dataset(const std::string& pattern, size_t maxOpen = DefaultMaxOpen)
+        : _maxOpen(std::max<size_t>(1, maxOpen))
+    {
+        // Size each shard (mapping them one at a time), and divide it into
+        //   work units.  Empty files (e.g., shards that have just been
+        //   created) can't be mapped, and are kept as shards without units.
+        const size_t unitSize = UnitBytes / sizeof(Type);
+
+        for (auto& path : list(pattern)) {
+            size_t shard = _shards.size();
+
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0 && info.st_size == 0) {
+                _shards.push_back({ path, 0, DataFormat::Aggregate{}, true, false });
+            }
+            else if (CompressedData<Type>::isCompressed(path)) {
+                CompressedData<Type> data(path.c_str());
+                _shards.push_back({ path, data.size(), data.aggregate(), true, true });
+
+                for (size_t block = 0; block < data.numBlocks(); ++block) {
+                    size_t begin = block * data.blockSize();
+                    _units.push_back({ shard, begin,
+                        begin + data.summaries()[block].count });
+                }
+            }
+            else {
+                Data<Type> data(path.c_str());
+                _shards.push_back({ path, data.size(),
+                    data.hasSummaries() ? data.aggregate() : DataFormat::Aggregate{},
+                    data.hasSummaries(), false });
+
+                for (size_t begin = 0; begin < data.size(); begin += unitSize) {
+                    _units.push_back({ shard, begin, std::min(data.size(), begin + unitSize) });
+                }
+            }
+
+            _size += _shards.back().size;
+        }
+
+        _mapped.resize(_shards.size());
+    }
+
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+
+    // Total number of values in all of the shards
+    size_t size() const
+        { return _size; }
+
+    size_t numShards() const
+        { return _shards.size(); }
+
+    const std::string& path(size_t shard) const
+        { return _shards[shard].path; }
+
+    size_t numUnits() const
+        { return _units.size(); }
+
+    const Unit& unit(size_t index) const
+        { return _units[index]; }
+
+    //-----------------------------------------------------------------------
+    //
+    // Summaries (as in Data::aggregate()) are only available if every
+    //   shard is a container
+    //
+    bool hasSummaries() const {
+        return std::all_of(_shards.begin(), _shards.end(),
+            [](const Shard& shard) { return shard.hasSummaries; });
+    }
+
+    DataFormat::Aggregate aggregate() const {
+        DataFormat::Aggregate result;
+        for (auto& shard : _shards) { result += shard.aggregate; }
+        return result;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // acquire() - map a shard (if it isn't already), returning a handle
+    //   that keeps it mapped while held (usually through a Reader).  When
+    //   over the limit, the least recently used shards that aren't held
+    //   are unmapped (if every shard is held, the limit is exceeded until
+    //   some are released).
+    //
+    Mapping acquire(size_t shard) {
+        std::lock_guard lock(_mutex);
+
+        auto used = std::find(_recent.begin(), _recent.end(), shard);
+        if (used != _recent.end()) {
+            _recent.splice(_recent.begin(), _recent, used);
+            return _mapped[shard];
+        }
+
+        for (auto i = _recent.end(); _recent.size() >= _maxOpen && i != _recent.begin(); ) {
+            --i;
+            if (_mapped[*i].useCount() == 1) {
+                _mapped[*i] = Mapping{};
+                i = _recent.erase(i);
+            }
+        }
+
+        const char* path = _shards[shard].path.c_str();
+        if (_shards[shard].compressed) {
+            _mapped[shard].compressed = std::make_shared<const CompressedData<Type>>(path);
+        }
+        else {
+            _mapped[shard].data = std::make_shared<const Data<Type>>(path);
+        }
+        _recent.push_front(shard);
+
+        return _mapped[shard];
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // read() - the range of values of a unit, mapping its shard (and
+    //   decoding its block, for compressed shards) as needed.  The values
+    //   stay valid until the reader is used for another unit.
+    //
+    std::pair<const Type*, const Type*> read(const Unit& unit, Reader& reader) {
+        if (unit.shard != reader.shard) {
+            reader.mapping = Mapping{};
+            reader.mapping = acquire(unit.shard);
+            reader.shard = unit.shard;
+        }
+
+        if (auto& compressed = reader.mapping.compressed) {
+            return compressed->decode(unit.begin / compressed->blockSize(), reader.scratch);
+        }
+
+        const Type* values = reader.mapping.data->data();
+        return { values + unit.begin, values + unit.end };
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Scheduler - hands out the work units, in order, to the threads
+    //   calling next() until there are none left
+    //
+    class Scheduler {
+        Dataset&            _dataset;
+        std::atomic<size_t> _next{0};
+
+      public:
+        explicit Scheduler(Dataset& dataset) : _dataset(dataset) {}
+
+        // Claim the next unit, returning false when they're all gone
+        bool next(Unit& unit) {
+            size_t index = _next++;
+            if (index >= _dataset.numUnits()) { return false; }
+            unit = _dataset.unit(index);
+            return true;
+        }
+    };
+};
+
+#endif // __DATASET_H__
@@ -0,0 +1,210 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Half.h ---
+//
+//  Reduced-precision (16-bit) floating-point storage types, for data that
+//    doesn't need all of a float's precision, and can be read in half the
+//    bytes:
+//
+//  - Half:  IEEE 754 binary16 (1 sign, 5 exponent, and 10 mantissa bits),
+//      with about three decimal digits of precision, and a range of about
+//      6e-8 to 65504
+//  - BFloat16:  "brain float" (1 sign, 8 exponent, and 7 mantissa bits),
+//      the top half of a float, so with a float's range, but only about
+//      two decimal digits of precision
+//
+//  Both are only for storage:  values convert (implicitly) to float for
+//    arithmetic.  widen() converts arrays of them to floats a vector at a
+//    time:  by default, with branch-free bit manipulation the compiler
+//    vectorizes (with SSE2, on x86-64), or for Half, with the F16C
+//    instructions when they're enabled (e.g., building with
+//    OPT="-O2 -mf16c", or -march=native).  Narrowing rounds to the nearest
+//    value (ties to even).
+//
+
+#ifndef __HALF_H__
+#define __HALF_H__
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "DataFormat.h"
+
+namespace Precision {
+
+inline uint32_t bits(float value)
+    { uint32_t b; std::memcpy(&b, &value, sizeof(b)); return b; }
+
+inline float fromBits(uint32_t b)
+    { float value; std::memcpy(&value, &b, sizeof(value)); return value; }
+
+// binary16 -> binary32, handling subnormals, infinities, and NaNs.  The
+//   portable version computes each case, and selects between them with
+//   masks rather than branches, so loops over it vectorize (see widen()).
+inline float halfToFloat(uint16_t h) {
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    const uint32_t exponentMask = 0x7c00u << 13;
+    const float    subnormalBias = fromBits(113u << 23);  // 2^-14
+
+    uint32_t b = (h & 0x7fffu) << 13;
+    uint32_t exponent = b & exponentMask;
+    b += (127u - 15u) << 23;
+
+    // Infinity or NaN (made quiet)
+    uint32_t special = b + ((128u - 16u) << 23);
+    special |= uint32_t((special & 0x007fffffu) != 0) << 22;
+
+    // Zero or subnormal
+    uint32_t subnormal = bits(fromBits(b + (1u << 23)) - subnormalBias);
+
+    uint32_t isSpecial = -uint32_t(exponent == exponentMask);  // all ones, or zero
+    uint32_t isSubnormal = -uint32_t(exponent == 0);
+    uint32_t result = (special & isSpecial) | (subnormal & isSubnormal)
+        | (b & ~(isSpecial | isSubnormal));
+
+    return fromBits(result | (uint32_t(h & 0x8000u) << 16));
+#endif
+}
+
+// binary32 -> binary16, rounding to nearest even
+inline uint16_t floatToHalf(float value) {
+#ifdef __F16C__
+    return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t b = bits(value);
+    uint16_t sign = (b >> 16) & 0x8000u;
+    b &= 0x7fffffffu;
+
+    uint16_t h;
+    if (b >= 0x7f800000u) {                // infinity or NaN
+        h = b > 0x7f800000u ? 0x7e00u | ((b >> 13) & 0x3ffu) : 0x7c00u;
+    }
+    else if (b >= 0x477ff000u) {           // rounds up past the largest half
+        h = 0x7c00u;
+    }
+    else if (b < 0x38800000u) {            // subnormal (or zero)
+        // Adding 0.5 lines the half's subnormal bits up with the float's
+        //   mantissa, so the FPU does the rounding
+        h = bits(fromBits(b) + 0.5f) - bits(0.5f);
+    }
+    else {
+        uint32_t odd = (b >> 13) & 1;
+        b += ((15u - 127u) << 23) + 0xfffu + odd;
+        h = b >> 13;
+    }
+
+    return h | sign;
+#endif
+}
+
+// binary32 -> bfloat16, rounding to nearest even
+inline uint16_t floatToBFloat16(float value) {
+    uint32_t b = bits(value);
+    if ((b & 0x7fffffffu) > 0x7f800000u) { return (b >> 16) | 0x0040u; }  // NaN
+    return (b + 0x7fffu + ((b >> 16) & 1)) >> 16;
+}
+
+inline float bfloat16ToFloat(uint16_t h)
+    { return fromBits(uint32_t(h) << 16); }
+
+} // namespace Precision
+
+//---------------------------------------------------------------------------
+//
+//  The storage types
+//
+
+struct Half {
+    uint16_t bits;
+
+    Half() = default;
+    Half(float value) : bits(Precision::floatToHalf(value)) {}
+
+    operator float() const
+        { return Precision::halfToFloat(bits); }
+};
+
+struct BFloat16 {
+    uint16_t bits;
+
+    BFloat16() = default;
+    BFloat16(float value) : bits(Precision::floatToBFloat16(value)) {}
+
+    operator float() const
+        { return Precision::bfloat16ToFloat(bits); }
+};
+
+namespace DataFormat {
+    template <> struct TypeCode<::Half>     { static constexpr Type value = Float16; };
+    template <> struct TypeCode<::BFloat16> { static constexpr Type value = BFloat16; };
+}
+
+//---------------------------------------------------------------------------
+//
+//  widen() - convert "count" values to floats
+//
+
+// -O2's cost model only vectorizes loops that need no scalar remainder,
+//   so the portable conversions are done in groups of a fixed size
+const size_t WidenGroup = 16;
+
+inline void widen(const Half* values, float* out, size_t count) {
+    size_t i = 0;
+#ifdef __F16C__
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+#else
+    for (; i + WidenGroup <= count; i += WidenGroup) {
+        for (size_t j = 0; j < WidenGroup; ++j) {
+            out[i + j] = Precision::halfToFloat(values[i + j].bits);
+        }
+    }
+#endif
+    for (; i < count; ++i) { out[i] = values[i]; }
+}
+
+inline void widen(const BFloat16* values, float* out, size_t count) {
+    // Just a shift
+    size_t i = 0;
+    for (; i + WidenGroup <= count; i += WidenGroup) {
+        for (size_t j = 0; j < WidenGroup; ++j) {
+            out[i + j] = Precision::bfloat16ToFloat(values[i + j].bits);
+        }
+    }
+    for (; i < count; ++i) { out[i] = values[i]; }
+}
+
+inline void widen(const float* values, float* out, size_t count)
+    { std::memcpy(out, values, count * sizeof(float)); }
+
+//---------------------------------------------------------------------------
+//
+//  narrow() - convert "count" floats to a reduced-precision type
+//
+
+template <typename T>
+void narrow(const float* values, T* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) { out[i] = T(values[i]); }
+}
+
+#ifdef __F16C__
+template <>
+inline void narrow(const float* values, Half* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    for (; i < count; ++i) { out[i] = Half(values[i]); }
+}
+#endif
+
+#endif // __HALF_H__
@@ -0,0 +1,300 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- PrefixIndex.h ---
+//
+//  A persistent "sidecar" index that answers the sum (and mean) of any
+//    range of values in a data file in constant time.
+//
+//  The index stores the prefix sums P[k] = data[0] + ... + data[k*stride - 1]
+//    for every stride'th index k (a "blocked" prefix sum).  The sum of the
+//    range [begin, end) is then
+//
+//      P[end / stride] + (the up to stride-1 values after it)
+//        - P[begin / stride] - (the up to stride-1 values after it)
+//
+//    so a query costs two index lookups and reads at most 2*(stride-1)
+//    contiguous values, regardless of the range's length.
+//
+//  Prefix sums of billions of floats lose precision quickly in a plain
+//    double, so each entry is kept as a compensated (Kahan-Babuska-
+//    Neumaier) pair of doubles:  the running sum, and the accumulated
+//    rounding error.
+//
+//  The index is stored next to the data file as "<file>.psum", in our
+//    container format (see DataFormat.h), and memory mapped through the
+//    Data class.  The container's metadata records the stride along with
+//    the data file's size, inode, and modification time;  if any of those
+//    don't match, the index is stale, and is rebuilt (in parallel), and
+//    renamed over the old one.
+//
+
+#ifndef __PREFIXINDEX_H__
+#define __PREFIXINDEX_H__
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <barrier>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Data.h"
+#include "DataFormat.h"
+
+//---------------------------------------------------------------------------
+//
+//  CompensatedSum - a running sum that also tracks its rounding error
+//
+
+struct CompensatedSum {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    void add(double value) {
+        double t = sum + value;
+        compensation += std::abs(sum) >= std::abs(value)
+            ? (sum - t) + value : (value - t) + sum;
+        sum = t;
+    }
+
+    void add(const CompensatedSum& s)
+        { add(s.sum); compensation += s.compensation; }
+
+    double value() const
+        { return sum + compensation; }
+};
+
+//---------------------------------------------------------------------------
+//
+//  PrefixEntry - one entry of the index, as stored in the sidecar file
+//
+
+struct PrefixEntry {
+    double sum;
+    double compensation;
+
+    operator double() const
+        { return sum + compensation; }
+};
+
+namespace DataFormat {
+    template <> struct TypeCode<PrefixEntry> { static constexpr Type value = PrefixSum; };
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- PrefixIndex ---
+//
+
+template <typename Type>
+class PrefixIndex {
+
+  public:
+    static constexpr size_t DefaultStride = 64;
+
+  private:
+    // Identifies the data file (and stride) an index was built for
+    struct Metadata {
+        uint64_t stride;
+        uint64_t count;
+        uint64_t size;
+        uint64_t inode;
+        int64_t  modified;   // in nanoseconds
+    };
+
+    const Data<Type>&                  _data;
+    std::string                        _path;
+    size_t                             _stride;
+    std::unique_ptr<Data<PrefixEntry>> _index;
+    bool                               _built = false;
+    double                             _buildTime = 0.0;
+
+    Metadata identify(const std::string& dataPath, size_t stride) const {
+        struct stat info;
+        if (stat(dataPath.c_str(), &info) == -1) {
+            std::stringstream error;
+            error << "Unable to stat() file '" << dataPath << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        return Metadata{ stride, _data.size(), uint64_t(info.st_size),
+            uint64_t(info.st_ino),
+            int64_t(info.st_mtim.tv_sec) * 1'000'000'000 + info.st_mtim.tv_nsec };
+    }
+
+    // Open the existing index, if there is one, and it matches the data
+    bool open(const Metadata& expected) {
+        try {
+            _index = std::make_unique<Data<PrefixEntry>>(_path.c_str());
+        }
+        catch (const std::exception&) {
+            _index.reset();
+            return false;
+        }
+
+        bool current = _index->metadataSize() == sizeof(Metadata)
+            && std::memcmp(_index->metadata(), &expected, sizeof(Metadata)) == 0
+            && _index->size() == expected.count / expected.stride + 1;
+
+        if (!current) { _index.reset(); }
+
+        return current;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // build() - compute the index in parallel, in the style of threaded.cpp.
+    //   Each thread sums the strides in its chunk of the data;  at the
+    //   barrier, the threads' totals are scanned to find where each
+    //   thread's prefix sums start;  and then each thread turns its stride
+    //   sums into prefix sums.
+    //
+
+    void build(const Metadata& metadata, size_t numThreads) {
+        auto start = std::chrono::steady_clock::now();
+
+        size_t numStrides = _data.size() / _stride;
+        std::vector<PrefixEntry> entries(numStrides + 1);
+
+        std::vector<std::jthread>    threads(numThreads);
+        std::vector<CompensatedSum>  totals(numThreads);
+
+        auto scan = [&]() noexcept {
+            CompensatedSum offset;
+            for (auto& total : totals) {
+                CompensatedSum t = total;
+                total = offset;
+                offset.add(t);
+            }
+        };
+        std::barrier barrier(numThreads, scan);
+
+        size_t chunkSize = (numStrides / numThreads) + 1;
+
+        for (size_t id = 0; id < threads.size(); ++id) {
+            threads[id] = std::jthread([&, id]() {
+                size_t begin = std::min(numStrides, id * chunkSize);
+                size_t end = std::min(numStrides, begin + chunkSize);
+
+                CompensatedSum total;
+                for (size_t k = begin; k < end; ++k) {
+                    const Type* values = _data.data() + k * _stride;
+                    double sum = 0.0;
+                    for (size_t i = 0; i < _stride; ++i) { sum += values[i]; }
+
+                    entries[k + 1].sum = sum;
+                    total.add(sum);
+                }
+                totals[id] = total;
+
+                barrier.arrive_and_wait();
+
+                CompensatedSum prefix = totals[id];
+                for (size_t k = begin; k < end; ++k) {
+                    prefix.add(entries[k + 1].sum);
+                    entries[k + 1] = PrefixEntry{ prefix.sum, prefix.compensation };
+                }
+            });
+        }
+
+        for (auto& thread : threads) { thread.join(); }
+
+        entries[0] = PrefixEntry{ 0.0, 0.0 };
+
+        // Write the index to a temporary file (named for this process, so
+        //   concurrent builders don't share it), and rename it into place,
+        //   so a program still mapping the old index keeps its (unlinked)
+        //   copy, rather than seeing it truncated underneath it
+        std::string temporary = _path + ".tmp." + std::to_string(getpid());
+        try {
+            DataWriter<PrefixEntry> writer(temporary.c_str(), "prefix-sum");
+            writer.setMetadata(&metadata, sizeof(metadata));
+            writer.write(entries.data(), entries.size());
+            writer.close();
+        }
+        catch (...) {
+            ::unlink(temporary.c_str());
+            throw;
+        }
+
+        if (::rename(temporary.c_str(), _path.c_str()) == -1) {
+            ::unlink(temporary.c_str());
+            std::stringstream error;
+            error << "Unable to replace index '" << _path << "'";
+            throw std::runtime_error(error.str());
+        }
+
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        _buildTime = seconds.count();
+        _built = true;
+    }
+
+    // The (compensated) sum of the values with indices less than "index"
+    CompensatedSum prefix(size_t index) const {
+        size_t k = index / _stride;
+        const PrefixEntry& entry = (*_index)[k];
+
+        CompensatedSum result{ entry.sum, entry.compensation };
+        for (size_t i = k * _stride; i < index; ++i) { result.add(_data[i]); }
+
+        return result;
+    }
+
+  public:
+    //-----------------------------------------------------------------------
+    //
+    // Open the index for "data" (which was opened from "dataPath"),
+    //   building it with "numThreads" threads if it's missing or stale
+    //
+    PrefixIndex(const Data<Type>& data, const std::string& dataPath,
+        size_t numThreads, size_t stride = DefaultStride)
+        : _data(data), _path(dataPath + ".psum"), _stride(std::max<size_t>(1, stride))
+    {
+        Metadata metadata = identify(dataPath, _stride);
+
+        if (!open(metadata)) {
+            build(metadata, numThreads);
+            if (!open(metadata)) {
+                std::stringstream error;
+                error << "Unable to open index '" << _path << "' after building it";
+                throw std::runtime_error(error.str());
+            }
+        }
+    }
+
+    // Was the index (re)built when it was opened, and if so, how long
+    //   did that take (in seconds)?
+    bool built() const
+        { return _built; }
+
+    double buildTime() const
+        { return _buildTime; }
+
+    const std::string& path() const
+        { return _path; }
+
+    //-----------------------------------------------------------------------
+    //
+    // The sum, and mean, of the values with indices in [begin, end)
+    //
+    double sum(size_t begin, size_t end) const {
+        end = std::min(end, _data.size());
+        if (begin >= end) { return 0.0; }
+
+        CompensatedSum high = prefix(end);
+        CompensatedSum low = prefix(begin);
+
+        return (high.sum - low.sum) + (high.compensation - low.compensation);
+    }
+
+    double mean(size_t begin, size_t end) const {
+        end = std::min(end, _data.size());
+        return begin < end ? sum(begin, end) / (end - begin) : 0.0;
+    }
+};
+
+#endif // __PREFIXINDEX_H__
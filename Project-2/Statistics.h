@@ -0,0 +1,278 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  --- Statistics.h ---
+//
+//  A collection of mergeable statistics, for computing a data set's
+//    statistics in a single parallel pass:  each thread accumulates the
+//    statistics of its part of the data, and the threads' results are
+//    then merged.
+//
+//  - RunningStats:  count, mean, variance, and extremes
+//  - Histogram:  counts of values in equal-width bins over a fixed range
+//  - QuantileSketch:  approximate quantiles (e.g., the median) in a
+//      small, fixed amount of memory
+//
+
+#ifndef __STATISTICS_H__
+#define __STATISTICS_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+//---------------------------------------------------------------------------
+//
+//  RunningStats - count, mean, variance, min and max
+//
+//  The variance uses Welford's formulation (tracking the mean, and M2, the
+//    sum of squared differences from the mean), which avoids the
+//    catastrophic cancellation of the textbook sum-of-squares formula.
+//    Values are added a chunk at a time:  a chunk's mean and M2 are
+//    computed directly (it's in cache, so the second pass is cheap), and
+//    then merged into the running values using Chan, Golub, and LeVeque's
+//    pairwise update, which is also how the threads' results are combined.
+//
+
+struct RunningStats {
+    uint64_t count = 0;
+    double   mean = 0.0;
+    double   m2 = 0.0;
+    double   min = std::numeric_limits<double>::infinity();
+    double   max = -std::numeric_limits<double>::infinity();
+
+    template <typename T>
+    void add(const T* begin, const T* end) {
+        if (begin == end) { return; }
+
+        RunningStats chunk;
+        chunk.count = end - begin;
+
+        double sum = 0.0;
+        for (auto p = begin; p != end; ++p) {
+            double value = *p;
+            sum += value;
+            chunk.min = std::min(chunk.min, value);
+            chunk.max = std::max(chunk.max, value);
+        }
+        chunk.mean = sum / chunk.count;
+
+        for (auto p = begin; p != end; ++p) {
+            double delta = *p - chunk.mean;
+            chunk.m2 += delta * delta;
+        }
+
+        merge(chunk);
+    }
+
+    void merge(const RunningStats& s) {
+        if (s.count == 0) { return; }
+
+        uint64_t n = count + s.count;
+        double delta = s.mean - mean;
+
+        mean += delta * s.count / n;
+        m2 += s.m2 + delta * delta * (double(count) * s.count / n);
+        count = n;
+        min = std::min(min, s.min);
+        max = std::max(max, s.max);
+    }
+
+    // Population, and sample, variance
+    double variance() const
+        { return count ? m2 / count : 0.0; }
+
+    double sampleVariance() const
+        { return count > 1 ? m2 / (count - 1) : 0.0; }
+};
+
+//---------------------------------------------------------------------------
+//
+//  Histogram - counts of values in numBins equal-width bins over [lo, hi].
+//    Values outside of the range are counted as underflow or overflow,
+//    and NaNs (which have no place in the range) separately.
+//
+
+struct Histogram {
+    double                lo = 0.0;
+    double                hi = 1.0;
+    std::vector<uint64_t> bins;
+    uint64_t              underflow = 0;
+    uint64_t              overflow = 0;
+    uint64_t              nans = 0;
+
+    Histogram() = default;
+
+    Histogram(size_t numBins, double lo, double hi)
+        : lo(lo), hi(hi), bins(std::max<size_t>(1, numBins)) {}
+
+    template <typename T>
+    void add(const T* begin, const T* end) {
+        const double scale = bins.size() / (hi - lo);
+        const size_t last = bins.size() - 1;
+
+        for (auto p = begin; p != end; ++p) {
+            double value = *p;
+            if (std::isnan(value)) { ++nans; }
+            else if (value < lo) { ++underflow; }
+            else if (value > hi) { ++overflow; }
+            else { ++bins[std::min(last, size_t((value - lo) * scale))]; }
+        }
+    }
+
+    void merge(const Histogram& h) {
+        for (size_t i = 0; i < bins.size(); ++i) { bins[i] += h.bins[i]; }
+        underflow += h.underflow;
+        overflow += h.overflow;
+        nans += h.nans;
+    }
+
+    double binWidth() const
+        { return (hi - lo) / bins.size(); }
+};
+
+//---------------------------------------------------------------------------
+//
+//  QuantileSketch - a KLL sketch (Karnin, Lang, and Liberty, 2016)
+//
+//  The sketch keeps a stack of "compactors".  Values enter at level 0;
+//    when a level holds more than its capacity, it's sorted, and every
+//    other value (starting at a random offset) is promoted to the next
+//    level, where each value stands in for twice as many of the original
+//    values.  Capacities shrink geometrically (by 2/3) going down from the
+//    top level, so the sketch's size is bounded by about 3k values no
+//    matter how many values are added, while quantiles have a rank error
+//    of roughly 1.7/k (about 0.7% for the default k).
+//
+//  Sketches merge by concatenating their levels, and compacting.
+//
+
+class QuantileSketch {
+    // The smallest capacity of any level;  KLL allows as few as two, but
+    //   a few more keeps the lowest levels from compacting constantly
+    static constexpr size_t MinCapacity = 8;
+
+    size_t                          _k;
+    uint64_t                        _count = 0;
+    uint64_t                        _nans = 0;  // (not in the sketch)
+    std::vector<std::vector<float>> _levels;
+    std::vector<size_t>             _capacities;
+    size_t                          _size = 0;
+    size_t                          _maxSize = 0;
+    std::minstd_rand                _random;
+
+    void addLevel() {
+        _levels.emplace_back();
+        _capacities.resize(_levels.size());
+
+        _maxSize = 0;
+        for (size_t h = 0; h < _levels.size(); ++h) {
+            size_t depth = _levels.size() - h - 1;
+            _capacities[h] = std::max(MinCapacity,
+                size_t(std::ceil(_k * std::pow(2.0 / 3.0, depth))));
+            _maxSize += _capacities[h];
+        }
+    }
+
+    // Compact the lowest level that's at (or over) its capacity
+    void compress() {
+        for (size_t h = 0; h < _levels.size(); ++h) {
+            if (_levels[h].size() < _capacities[h]) { continue; }
+
+            if (h + 1 == _levels.size()) { addLevel(); }
+
+            auto& level = _levels[h];
+            auto& next = _levels[h + 1];
+
+            // An odd value out stays behind
+            float leftover = level.back();
+            bool odd = level.size() % 2;
+            if (odd) { level.pop_back(); }
+
+            std::sort(level.begin(), level.end());
+            for (size_t i = _random() & 1; i < level.size(); i += 2) {
+                next.push_back(level[i]);
+            }
+
+            _size -= level.size() / 2;
+            level.clear();
+            if (odd) { level.push_back(leftover); }
+
+            return;
+        }
+    }
+
+  public:
+    explicit QuantileSketch(size_t k = 256, unsigned seed = 1)
+        : _k(k), _random(seed) { addLevel(); }
+
+    template <typename T>
+    void add(const T* begin, const T* end) {
+        for (auto p = begin; p != end; ++p) {
+            // NaNs can't be ordered (sorting them is undefined), so they're
+            //   only counted
+            float value = *p;
+            if (std::isnan(value)) { ++_nans; continue; }
+
+            _levels[0].push_back(value);
+            ++_size;
+            ++_count;
+
+            if (_levels[0].size() >= _capacities[0]) {
+                compress();
+                while (_size > _maxSize) { compress(); }
+            }
+        }
+    }
+
+    void merge(const QuantileSketch& s) {
+        while (_levels.size() < s._levels.size()) { addLevel(); }
+        for (size_t h = 0; h < s._levels.size(); ++h) {
+            _levels[h].insert(_levels[h].end(), s._levels[h].begin(),
+                s._levels[h].end());
+        }
+        _size += s._size;
+        _count += s._count;
+        _nans += s._nans;
+
+        while (_size > _maxSize) { compress(); }
+    }
+
+    // The number of values in the sketch, and of NaNs left out of it
+    uint64_t count() const
+        { return _count; }
+
+    uint64_t nans() const
+        { return _nans; }
+
+    // The approximate q-quantile, for q in [0, 1]
+    double quantile(double q) const {
+        std::vector<std::pair<float, uint64_t>> items;
+        uint64_t totalWeight = 0;
+
+        for (size_t h = 0; h < _levels.size(); ++h) {
+            for (auto value : _levels[h]) {
+                items.emplace_back(value, uint64_t(1) << h);
+                totalWeight += uint64_t(1) << h;
+            }
+        }
+
+        if (items.empty()) { return std::numeric_limits<double>::quiet_NaN(); }
+
+        std::sort(items.begin(), items.end());
+
+        double target = std::clamp(q, 0.0, 1.0) * totalWeight;
+        uint64_t weight = 0;
+        for (auto& [value, w] : items) {
+            weight += w;
+            if (weight >= target) { return value; }
+        }
+
+        return items.back().first;
+    }
+};
+
+#endif // __STATISTICS_H__
@@ -0,0 +1,245 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- client.cpp ---
+//
+// A load generator for server.cpp.  Each of a number of connections (each
+//   with its own thread) sends requests one at a time, waiting for each
+//   reply before sending the next (a "closed loop"), and records how long
+//   each took.  The requests are either the one given on the command line,
+//   or those in a file (one per line), which each connection cycles
+//   through.  A few warm-up requests per connection (which open and map
+//   the datasets, and fault in their pages) aren't counted.
+//
+// The throughput (queries per second), and the latency distribution
+//   (median, 99th percentile, and maximum) are reported.
+//
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A connection to the server, reading its replies a line at a time
+class Connection {
+    int         _fd;
+    std::string _pending;
+
+  public:
+    explicit Connection(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (_fd < 0 || connect(_fd, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) == -1)
+        {
+            std::stringstream error;
+            error << "Unable to connect to '" << path << "': " << strerror(errno);
+            throw std::runtime_error(error.str());
+        }
+    }
+
+    ~Connection()
+        { close(_fd); }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Send "request", and wait for its reply
+    std::string query(const std::string& request) {
+        std::string line = request + "\n";
+        for (size_t sent = 0; sent < line.size(); ) {
+            ssize_t n = send(_fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0) { throw std::runtime_error("Lost the connection to the server"); }
+            sent += n;
+        }
+
+        size_t newline;
+        while ((newline = _pending.find('\n')) == std::string::npos) {
+            char buffer[4096];
+            ssize_t n = read(_fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { throw std::runtime_error("Lost the connection to the server"); }
+            _pending.append(buffer, n);
+        }
+
+        std::string reply = _pending.substr(0, newline);
+        _pending.erase(0, newline + 1);
+        return reply;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- main ---
+//
+int main(int argc, char* argv[]) {
+    std::string path = "stats.sock";
+    std::string request = "MEAN data.bin";
+    std::string requestFile;
+    size_t numConnections = 4;
+    size_t numRequests = 1000;
+    size_t numWarmup = 10;
+
+    int option;
+    const char* options = "c:f:hn:r:s:w:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[cfhnrsw]\n"
+                    "    -h           show help message\n"
+                    "    -c <value>   use <value> concurrent connections (default: %zu)\n"
+                    "    -f <name>    send the requests in <name>, one per line\n"
+                    "    -n <value>   send <value> requests per connection (default: %zu)\n"
+                    "    -r <request> the request to send (default: \"%s\")\n"
+                    "    -s <name>    connect to the server's socket <name>\n"
+                    "                   (default: %s)\n"
+                    "    -w <value>   warm-up requests per connection, not counted\n"
+                    "                   (default: %zu)\n";
+
+                    fprintf(stderr, help, argv[0], numConnections, numRequests,
+                        request.c_str(), path.c_str(), numWarmup);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'c':
+                numConnections = std::max(1l, std::stol(optarg));
+                break;
+
+            case 'f':
+                requestFile = optarg;
+                break;
+
+            case 'n':
+                numRequests = std::stol(optarg);
+                break;
+
+            case 'r':
+                request = optarg;
+                break;
+
+            case 's':
+                path = optarg;
+                break;
+
+            case 'w':
+                numWarmup = std::stol(optarg);
+                break;
+        }
+    }
+
+    std::vector<std::string> requests;
+    if (requestFile.empty()) {
+        requests.push_back(request);
+    }
+    else {
+        std::ifstream file(requestFile);
+        if (!file) {
+            std::cerr << "Unable to open request file '" << requestFile << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        for (std::string line; std::getline(file, line); ) {
+            if (!line.empty()) { requests.push_back(line); }
+        }
+        if (requests.empty()) {
+            std::cerr << "No requests in '" << requestFile << "'\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Each connection's thread records its latencies (in seconds), and
+    //   error count, in its own slot;  the connections are all made, and
+    //   warmed up, before any of them starts the timed requests.
+    //
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::jthread>         threads(numConnections);
+    std::vector<std::vector<double>>  latencies(numConnections);
+    std::vector<size_t>               errors(numConnections);
+    std::string                       firstReply;
+    std::barrier                      barrier(numConnections + 1);
+
+    for (size_t id = 0; id < numConnections; ++id) {
+        threads[id] = std::jthread([&, id]() {
+            try {
+                Connection connection(path);
+
+                for (size_t i = 0; i < numWarmup; ++i) {
+                    std::string reply = connection.query(requests[i % requests.size()]);
+                    if (id == 0 && i == 0) { firstReply = reply; }
+                }
+
+                barrier.arrive_and_wait();
+
+                latencies[id].reserve(numRequests);
+                for (size_t i = 0; i < numRequests; ++i) {
+                    auto start = Clock::now();
+                    std::string reply = connection.query(
+                        requests[(numWarmup + i) % requests.size()]);
+                    std::chrono::duration<double> seconds = Clock::now() - start;
+
+                    latencies[id].push_back(seconds.count());
+                    if (reply.compare(0, 3, "ERR") == 0) { ++errors[id]; }
+                    if (id == 0 && i == 0 && numWarmup == 0) { firstReply = reply; }
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+                exit(EXIT_FAILURE);
+            }
+        });
+    }
+
+    barrier.arrive_and_wait();
+    auto start = Clock::now();
+
+    for (auto& thread : threads) { thread.join(); }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    //-----------------------------------------------------------------------
+    //
+    // Report the results
+    //
+    std::vector<double> all;
+    size_t numErrors = 0;
+    for (size_t id = 0; id < numConnections; ++id) {
+        all.insert(all.end(), latencies[id].begin(), latencies[id].end());
+        numErrors += errors[id];
+    }
+
+    if (all.empty()) {
+        std::cout << "Reply = " << firstReply << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return 1e6 * all[std::min(all.size() - 1, size_t(p * all.size()))];
+    };
+
+    std::cout << "Reply = " << firstReply << "\n";
+    std::cout << "Requests = " << all.size() << "\n";
+    std::cout << "Errors = " << numErrors << "\n";
+    std::cout << "Queries/s = " << all.size() / elapsed.count() << "\n";
+    std::cout << "p50 latency = " << percentile(0.50) << " us\n";
+    std::cout << "p99 latency = " << percentile(0.99) << " us\n";
+    std::cout << "Max latency = " << 1e6 * all.back() << " us\n";
+}
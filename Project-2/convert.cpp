@@ -0,0 +1,221 @@
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Header files for the Data template class, and the container formats
+#include "Compressed.h"
+#include "Data.h"
+#include "DataFormat.h"
+#include "Half.h"
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- verify() ---
+//
+//  Check each block of the container at "path" against its checksum
+//
+template <typename Type>
+int verify(const char* path) {
+    auto check = [&](const auto& data) {
+        size_t block = data.verify();
+        if (block != data.numBlocks()) {
+            std::cerr << "Checksum mismatch in block " << block << "\n";
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "Blocks = " << data.numBlocks() << " (all checksums match)\n";
+        return EXIT_SUCCESS;
+    };
+
+    if (CompressedData<Type>::isCompressed(path)) {
+        return check(CompressedData<Type>(path));
+    }
+
+    Data<Type> data(path);
+    if (!data.hasSummaries()) {
+        std::cerr << "'" << path << "' is not a container\n";
+        return EXIT_FAILURE;
+    }
+
+    return check(data);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- convert() ---
+//
+//  Write the floats in "input" to a container of "Type" values at "path".
+//    When narrowing to a reduced-precision type (see Half.h), the errors
+//    that introduces, relative to the original (fp32) values, are
+//    reported too.
+//
+template <typename Type>
+void convert(const Data<float>& input, const char* path, const std::string& name,
+    size_t blockSize, bool compress)
+{
+    constexpr bool narrowing = !std::is_same_v<Type, float>;
+
+    double maxError = 0.0;
+    double squaredError = 0.0;
+    DataFormat::Aggregate original;
+
+    // Copy the data over in large chunks, rather than one value at a time
+    auto copy = [&](auto& output) {
+        const size_t chunkSize = 1 << 20;
+        std::vector<Type> values(narrowing ? chunkSize : 0);
+
+        for (size_t i = 0; i < input.size(); i += chunkSize) {
+            const float* chunk = input.data() + i;
+            size_t n = std::min(chunkSize, input.size() - i);
+
+            if constexpr (narrowing) {
+                narrow(chunk, values.data(), n);
+                for (size_t j = 0; j < n; ++j) {
+                    double error = double(float(values[j])) - chunk[j];
+                    maxError = std::max(maxError, std::abs(error));
+                    squaredError += error * error;
+                }
+                original.add(chunk, chunk + n);
+                output.write(values.data(), n);
+            }
+            else {
+                output.write(chunk, n);
+            }
+        }
+        output.close();
+    };
+
+    auto report = [&](const auto& result) {
+        auto aggregate = result.aggregate();
+
+        std::cout << "Samples = " << result.size() << "\n";
+        std::cout << "Type = " << DataFormat::typeName(DataFormat::TypeCode<Type>::value) << "\n";
+        std::cout << "Blocks = " << result.numBlocks() << "\n";
+        std::cout << "Mean = " << aggregate.mean() << "\n";
+        std::cout << "Min = " << aggregate.min << "\n";
+        std::cout << "Max = " << aggregate.max << "\n";
+
+        if (narrowing) {
+            std::cout << "fp32 mean = " << original.mean() << " (error "
+                << aggregate.mean() - original.mean() << ")\n";
+            std::cout << "Max. error = " << maxError << "\n";
+            std::cout << "RMS error = " << std::sqrt(squaredError / input.size()) << "\n";
+        }
+    };
+
+    if (compress) {
+        {
+            CompressedWriter<Type> output(path, name.c_str(), blockSize);
+            copy(output);
+        }
+
+        CompressedData<Type> result(path);
+        report(result);
+        std::cout << "Compression ratio = "
+            << double(input.size() * sizeof(float)) / result.compressedSize() << "\n";
+        return;
+    }
+
+    {
+        DataWriter<Type> output(path, name.c_str(), blockSize);
+        copy(output);
+    }
+
+    report(Data<Type>(path));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- main ---
+//
+//  Convert a raw (headerless) file of floats, like data.bin, into the
+//    self-describing container format (see DataFormat.h), or its
+//    compressed variant (see Compressed.h), optionally narrowing the
+//    values to a reduced-precision type (see Half.h), or verify the
+//    checksums of an existing container.
+//
+int main(int argc, char* argv[]) {
+    size_t blockSize = DataFormat::DefaultBlockSize;
+    std::string name = "value";
+    std::string type = "float";
+    bool verifying = false;
+    bool compress = false;
+
+    int option;
+    const char* options = "b:hn:T:Vz";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[bhnTz] <input> <output>\n"
+                    "       %s -V <file>\n"
+                    "    -h           show help message\n"
+                    "    -b <value>   values per block (default: %zu)\n"
+                    "    -n <name>    name of the values (default: %s)\n"
+                    "    -T <type>    store the values as float, float16, or bfloat16\n"
+                    "                   (default: %s)\n"
+                    "    -z           write a compressed container\n"
+                    "    -V           verify a container's checksums\n";
+
+                    fprintf(stderr, help, argv[0], argv[0], blockSize, name.c_str(),
+                        type.c_str());
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'b':
+                blockSize = std::stol(optarg);
+                break;
+
+            case 'n':
+                name = optarg;
+                break;
+
+            case 'T':
+                type = optarg;
+                if (type == "half") { type = "float16"; }
+                if (type != "float" && type != "float16" && type != "bfloat16") {
+                    std::cerr << "Unknown type '" << type << "'\n";
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'V':
+                verifying = true;
+                break;
+
+            case 'z':
+                compress = true;
+                break;
+        }
+    }
+
+    if (verifying) {
+        if (optind >= argc) {
+            std::cerr << "Missing file to verify (use -h for help)\n";
+            exit(EXIT_FAILURE);
+        }
+
+        const char* path = argv[optind];
+        switch (DataFormat::elementType(path, DataFormat::Float32)) {
+            case DataFormat::Float16:  return verify<Half>(path);
+            case DataFormat::BFloat16: return verify<BFloat16>(path);
+            default:                   return verify<float>(path);
+        }
+    }
+
+    if (optind + 2 > argc) {
+        std::cerr << "Missing input or output file (use -h for help)\n";
+        exit(EXIT_FAILURE);
+    }
+
+    Data<float> input(argv[optind]);
+    const char* output = argv[optind + 1];
+
+    if (type == "float16") { convert<Half>(input, output, name, blockSize, compress); }
+    else if (type == "bfloat16") { convert<BFloat16>(input, output, name, blockSize, compress); }
+    else { convert<float>(input, output, name, blockSize, compress); }
+}
@@ -0,0 +1,277 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- generate.cpp ---
+//
+// Generate a data file (like data.bin) of random floats, for use with
+//   mean.out and threaded.out, from one of a few distributions:
+//
+//   * uniform - uniformly distributed in [a, b] (default: [0, 1])
+//   * normal  - normally distributed with mean mu, and standard deviation
+//                 sigma (default: 0, 1)
+//   * pareto  - a heavy-tailed Pareto distribution with scale xm, and
+//                 shape alpha (default: 1, 1.5, for which the mean is
+//                 finite, but the variance isn't)
+//
+// The values are generated in fixed-size chunks, each with its own random
+//   number generator seeded from the seed and the chunk's index, so the
+//   file's contents only depend on the seed (and not on the number of
+//   threads).  Threads claim chunks, generate them into aligned buffers,
+//   and write them directly to their place in the file using pwrite(),
+//   with O_DIRECT (where the file system supports it) to bypass the page
+//   cache.
+//
+// Both the distribution's expected mean and the generated values' mean
+//   are reported, to validate the programs that compute the mean.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Values per chunk (4 MB of floats), and the buffer alignment O_DIRECT needs
+const size_t ChunkSize = 1 << 20;
+const size_t Alignment = 4096;
+
+int main(int argc, char* argv[]) {
+    std::string filename = "data.bin";
+    std::string distribution = "uniform";
+    std::vector<double> parameters;
+    size_t numValues = 1'000'000;
+    unsigned long seed = 1;
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    int option;
+    const char* options = "d:hn:o:p:s:t:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[dhnopst]\n"
+                    "    -h           show help message\n"
+                    "    -d <name>    distribution: uniform, normal, or pareto (default: %s)\n"
+                    "    -n <value>   number of values (default: %zu)\n"
+                    "    -o <name>    write values to <name> (default: %s)\n"
+                    "    -p <a,b>     distribution parameters (uniform: a,b  normal: mu,sigma\n"
+                    "                   pareto: xm,alpha)\n"
+                    "    -s <value>   random number seed (default: %lu)\n"
+                    "    -t <value>   use <value> threads (default: %zu)\n";
+
+                    fprintf(stderr, help, argv[0], distribution.c_str(), numValues,
+                        filename.c_str(), seed, numThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'd':
+                distribution = optarg;
+                break;
+
+            case 'n':
+                numValues = std::stol(optarg);
+                break;
+
+            case 'o':
+                filename = optarg;
+                break;
+
+            case 'p': {
+                parameters.clear();
+                char* p = optarg;
+                while (*p) {
+                    parameters.push_back(std::strtod(p, &p));
+                    if (*p == ',') { ++p; }
+                    else if (*p) {
+                        std::cerr << "Invalid parameters '" << optarg << "'\n";
+                        exit(EXIT_FAILURE);
+                    }
+                }
+            } break;
+
+            case 's':
+                seed = std::stoul(optarg);
+                break;
+
+            case 't': {
+                long value = std::stol(optarg);
+                if (value < 1) {
+                    std::cerr << "The number of threads must be at least 1\n";
+                    exit(EXIT_FAILURE);
+                }
+                numThreads = value;
+            } break;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Select the distribution, and compute its expected mean
+    //
+    auto parameter = [&](size_t i, double value) {
+        return i < parameters.size() ? parameters[i] : value;
+    };
+
+    double p0 = 0.0;
+    double p1 = 0.0;
+    double expectedMean = 0.0;
+
+    if (distribution == "uniform") {
+        p0 = parameter(0, 0.0);
+        p1 = parameter(1, 1.0);
+        expectedMean = 0.5 * (p0 + p1);
+    }
+    else if (distribution == "normal") {
+        p0 = parameter(0, 0.0);
+        p1 = parameter(1, 1.0);
+        expectedMean = p0;
+    }
+    else if (distribution == "pareto") {
+        p0 = parameter(0, 1.0);
+        p1 = parameter(1, 1.5);
+        expectedMean = p1 > 1.0 ? p1 * p0 / (p1 - 1.0) : INFINITY;
+    }
+    else {
+        std::cerr << "Unknown distribution '" << distribution << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Fill "values" with chunk number "chunk" of the data, returning their sum
+    auto generate = [&](size_t chunk, float* values, size_t count) {
+        std::seed_seq seeds{ uint32_t(seed), uint32_t(seed >> 32),
+            uint32_t(chunk), uint32_t(chunk >> 32) };
+        std::mt19937_64 generator(seeds);
+
+        if (distribution == "uniform") {
+            std::uniform_real_distribution<float> uniform(p0, p1);
+            for (size_t i = 0; i < count; ++i) { values[i] = uniform(generator); }
+        }
+        else if (distribution == "normal") {
+            std::normal_distribution<float> normal(p0, p1);
+            for (size_t i = 0; i < count; ++i) { values[i] = normal(generator); }
+        }
+        else {
+            // Inverse transform sampling: xm / U^(1/alpha), with U in (0, 1]
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = p0 / std::pow(1.0 - uniform(generator), 1.0 / p1);
+            }
+        }
+
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i) { sum += values[i]; }
+        return sum;
+    };
+
+    //-----------------------------------------------------------------------
+    //
+    // Open the output file, preferring direct I/O, and size it up front
+    //
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    bool direct = true;
+    int fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {
+        direct = false;
+        fd = open(filename.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        std::cerr << "Unable to open() file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    const off_t fileSize = off_t(numValues) * sizeof(float);
+    if (ftruncate(fd, fileSize) == -1) {
+        std::cerr << "Unable to ftruncate() file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Generate, and write, the chunks in parallel.  With direct I/O, the
+    //   final (partial) chunk is padded out to the alignment, and the
+    //   padding removed afterwards by truncating the file.
+    //
+    const size_t numChunks = (numValues + ChunkSize - 1) / ChunkSize;
+    std::vector<double> sums(numChunks);
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> outOfMemory{false};
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::jthread> threads(numThreads);
+    for (auto& thread : threads) {
+        thread = std::jthread([&]() {
+            const size_t bufferSize = ChunkSize * sizeof(float);
+            std::unique_ptr<float, decltype(&std::free)> buffer(
+                static_cast<float*>(std::aligned_alloc(Alignment, bufferSize)),
+                &std::free);
+            if (!buffer) {
+                failed = true;
+                outOfMemory = true;
+                return;
+            }
+
+            for (size_t chunk; !failed && (chunk = nextChunk++) < numChunks; ) {
+                size_t count = std::min(ChunkSize, numValues - chunk * ChunkSize);
+                sums[chunk] = generate(chunk, buffer.get(), count);
+
+                size_t numBytes = count * sizeof(float);
+                if (direct) {
+                    numBytes = (numBytes + Alignment - 1) / Alignment * Alignment;
+                    std::memset(reinterpret_cast<char*>(buffer.get()) + count * sizeof(float),
+                        0, numBytes - count * sizeof(float));
+                }
+
+                const char* bytes = reinterpret_cast<const char*>(buffer.get());
+                off_t offset = off_t(chunk) * bufferSize;
+                while (numBytes > 0) {
+                    ssize_t n = pwrite(fd, bytes, numBytes, offset);
+                    if (n <= 0) { failed = true; break; }
+                    bytes += n;
+                    offset += n;
+                    numBytes -= n;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+
+    if (outOfMemory) {
+        close(fd);
+        std::cerr << "Unable to allocate a " << ChunkSize * sizeof(float)
+            << " byte buffer\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (failed || ftruncate(fd, fileSize) == -1 || close(fd) == -1) {
+        std::cerr << "Unable to write() file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    //-----------------------------------------------------------------------
+    //
+    // Report the results.
+    //
+    double sum = 0.0;
+    for (auto s : sums) { sum += s; }
+
+    std::cout << "Samples = " << numValues << "\n";
+    std::cout << "Expected mean = " << expectedMean << "\n";
+    std::cout << "Mean = " << sum / numValues << "\n";
+    std::cerr << "Wrote " << fileSize / 1.0e9 << " GB in " << seconds.count()
+        << " s (" << fileSize / 1.0e9 / seconds.count() << " GB/s"
+        << (direct ? ", direct I/O" : "") << ")\n";
+}
@@ -1,11 +1,231 @@
-
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/inotify.h>
+#include <unistd.h>
 
 // Header file for the Data template class
+#include "Checkpoint.h"
+#include "Compressed.h"
 #include "Data.h"
+#include "Half.h"
+#include "PrefixIndex.h"
 
-int main(int argc, char* argv[]) {
-    const char* filename = argc < 2 ? "data.bin" : argv[1];
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- queries() ---
+//
+// Answer a batch of range-mean queries, one "<begin> <end>" pair per line
+//   of "source" (a filename, or "-" for stdin), using a prefix-sum index
+//   (see PrefixIndex.h), which is built (in parallel) the first time it's
+//   needed.  The means are written to stdout, one per line;  the index
+//   build time, and query throughput, are reported on stderr.
+//
+template <typename Type>
+void queries(const Data<Type>& data, const std::string& filename,
+    const std::string& source, size_t numThreads)
+{
+    PrefixIndex<Type> index(data, filename, numThreads);
+
+    if (index.built()) {
+        std::cerr << "Index build time = " << index.buildTime() << " s ("
+            << index.path() << ")\n";
+    }
+
+    std::ifstream file;
+    if (source != "-") {
+        file.open(source);
+        if (!file) {
+            std::cerr << "Unable to open query file '" << source << "'\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::istream& input = source == "-" ? std::cin : file;
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t begin, end; input >> begin >> end; ) {
+        ranges.emplace_back(begin, end);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<double> means(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        means[i] = index.mean(ranges[i].first, ranges[i].second);
+    }
+
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    for (auto mean : means) {
+        std::cout << mean << "\n";
+    }
+
+    std::cerr << "Queries = " << ranges.size() << "\n";
+    std::cerr << "Query throughput = " << ranges.size() / seconds.count()
+        << " queries/s\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- incremental() ---
+//
+// Compute the mean of an append-only data file incrementally:  the running
+//   count and (compensated) sum are kept in a checkpoint file (see
+//   Checkpoint.h), so each run only reads the values appended since the
+//   previous one.  If "follow" is set, the file is then watched (using
+//   inotify), and the mean updated each time the file grows, until it's
+//   deleted or renamed.
+//
+void incremental(const std::string& filename, const std::string& checkpointFile,
+    bool follow)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open() file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    char header[sizeof(DataFormat::FileHeader)];
+    if (pread(fd, header, sizeof(header), 0) == sizeof(header)
+        && DataFormat::isContainer(header, sizeof(header))) {
+        std::cerr << "Incremental means are only supported for raw data files\n";
+        exit(EXIT_FAILURE);
+    }
+
+    Checkpoint checkpoint = Checkpoint::load(checkpointFile);
+
+    // Read the values from the checkpoint's offset to the end of the file
+    //   (leaving any partially-written value for next time), and save the
+    //   updated checkpoint
+    auto update = [&]() {
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            std::cerr << "Unable to stat() file '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+
+        if (!checkpoint.matches(fd, info)) {
+            if (checkpoint.count > 0) {
+                std::cerr << "Checkpoint '" << checkpointFile << "' doesn't match '"
+                    << filename << "'; starting over\n";
+            }
+            checkpoint = Checkpoint{};
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        const size_t end = info.st_size - info.st_size % sizeof(float);
+        CompensatedSum sum{ checkpoint.sum, checkpoint.compensation };
+        uint64_t count = 0;
+
+        std::vector<float> buffer(1 << 18);
+        for (size_t offset = checkpoint.offset; offset < end; ) {
+            size_t numBytes = std::min(end - offset, buffer.size() * sizeof(float));
+            ssize_t n = pread(fd, buffer.data(), numBytes, offset);
+            if (n <= 0) {
+                std::cerr << "Unable to read() file '" << filename << "'\n";
+                exit(EXIT_FAILURE);
+            }
+            n -= n % sizeof(float);
+
+            double partial = 0.0;
+            for (size_t i = 0; i < n / sizeof(float); ++i) { partial += buffer[i]; }
+            sum.add(partial);
+
+            count += n / sizeof(float);
+            offset += n;
+        }
+
+        checkpoint.count += count;
+        checkpoint.sum = sum.sum;
+        checkpoint.compensation = sum.compensation;
+        checkpoint.offset = end;
+        checkpoint.identify(fd, info);
+        checkpoint.save(checkpointFile);
+
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Samples = " << checkpoint.count << "\n";
+        if (checkpoint.count > 0) {
+            std::cout << "Mean = " << sum.value() / checkpoint.count << std::endl;
+        }
+        else {
+            std::cout << "Mean = (no samples)" << std::endl;
+        }
+        std::cerr << "New samples = " << count << " (" << seconds.count() << " s)\n";
+    };
+
+    update();
+
+    if (!follow) { return; }
+
+    int watcher = inotify_init1(0);
+    if (watcher < 0 || inotify_add_watch(watcher, filename.c_str(),
+            IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        std::cerr << "Unable to watch file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    alignas(inotify_event) char events[4096];
+    for (bool watching = true; watching; ) {
+        ssize_t n = read(watcher, events, sizeof(events));
+        if (n <= 0) { break; }
+
+        bool modified = false;
+        for (char* p = events; p < events + n; ) {
+            auto event = reinterpret_cast<const inotify_event*>(p);
+            modified |= (event->mask & IN_MODIFY) != 0;
+            watching &= !(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED));
+            p += sizeof(inotify_event) + event->len;
+        }
+
+        if (modified) { update(); }
+    }
+
+    close(watcher);
+    close(fd);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- mean() ---
+//
+// Compute the mean of the values (of type "Type") in "filename", over the
+//   optional range of indices in argv (or answer the queries in
+//   "queryFile")
+//
+template <typename Type>
+void mean(const char* filename, const std::string& queryFile, size_t numThreads,
+    int argc, char* argv[])
+{
+    // An optional range of indices [begin, end) to average over
+    size_t begin = argc > 3 ? std::stoul(argv[2]) : 0;
+    size_t end = argc > 3 ? std::stoul(argv[3]) : SIZE_MAX;
+
+    //-----------------------------------------------------------------------
+    //
+    // Compressed containers (see Compressed.h) can't be mapped as an array
+    //   of values, but like other containers, carry block summaries, so
+    //   only the blocks partially covered by the range are decoded.
+    //
+    if (CompressedData<Type>::isCompressed(filename)) {
+        if (!queryFile.empty()) {
+            std::cerr << "Range queries aren't supported for compressed files\n";
+            exit(EXIT_FAILURE);
+        }
+
+        CompressedData<Type> data(filename);
+        auto aggregate = data.aggregate(begin, end);
+
+        std::cout << "Samples = " << aggregate.count << "\n";
+        std::cout << "Mean = " << aggregate.mean() << "\n";
+        return;
+    }
 
     //-----------------------------------------------------------------------
     //
@@ -15,22 +235,150 @@ int main(int argc, char* argv[]) {
     //   Data class makes it look more like a std::vector), allowing indexed
     //   random-access to the data.
     //
-    Data<float>  data(filename);
+    Data<Type>  data(filename);
+
+    if (!queryFile.empty()) {
+        queries(data, filename, queryFile, numThreads);
+        return;
+    }
+
+    end = std::min(end, data.size());
+    if (begin > end) { begin = end; }
+
+    //-----------------------------------------------------------------------
+    //
+    // Container files (see DataFormat.h) carry a summary of each block of
+    //   values, so the mean can be computed from those, only reading the
+    //   values of blocks partially covered by the range.
+    //
+    if (data.hasSummaries()) {
+        auto aggregate = data.aggregate(begin, end);
+
+        std::cout << "Samples = " << aggregate.count << "\n";
+        std::cout << "Mean = " << aggregate.mean() << "\n";
+        return;
+    }
 
     //-----------------------------------------------------------------------
     //
     // The computational kernel that computes the mean by summing the
-    //   values in the data array. 
+    //   values in the data array.
     double sum = 0.0;
-    for (size_t i = 0; i < data.size(); ++i) {
-        sum += data[i];
+    if constexpr (std::is_same_v<Type, float>) {
+        for (size_t i = begin; i < end; ++i) {
+            sum += data[i];
+        }
+    }
+    else {
+        // Reduced-precision values (see Half.h) are widened to floats a
+        //   chunk at a time, which vectorizes, and then summed
+        const size_t chunkSize = 4096;
+        float values[chunkSize];
+        for (size_t i = begin; i < end; i += chunkSize) {
+            size_t n = std::min(chunkSize, end - i);
+            widen(data.data() + i, values, n);
+            for (size_t j = 0; j < n; ++j) { sum += values[j]; }
+        }
     }
 
     //-----------------------------------------------------------------------
     //
     // Report the results.
     //
-    std::cout << "Samples = " << data.size() << "\n";
-    std::cout << "Mean = " << sum / data.size() << "\n";
+    std::cout << "Samples = " << end - begin << "\n";
+    std::cout << "Mean = " << sum / (end - begin) << "\n";
 }
 
+int main(int argc, char* argv[]) {
+    std::string queryFile;
+    std::string checkpointFile;
+    bool follow = false;
+    uint32_t rawType = DataFormat::Float32;
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    int option;
+    const char* options = "Fhi:q:t:T:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[FhiqtT] [file [begin end]]\n"
+                    "    -h           show help message\n"
+                    "    -i <name>    compute the mean incrementally, keeping a checkpoint in <name>\n"
+                    "    -F           with -i, follow the file, updating the mean as it grows\n"
+                    "    -q <name>    answer the range queries in <name> ('-' for stdin)\n"
+                    "    -t <value>   use <value> threads to build the query index (default: %zu)\n"
+                    "    -T <type>    type of a raw file's values: float, float16, or bfloat16\n"
+                    "                   (default: float)\n";
+
+                    fprintf(stderr, help, argv[0], numThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'F':
+                follow = true;
+                break;
+
+            case 'i':
+                checkpointFile = optarg;
+                break;
+
+            case 'q':
+                queryFile = optarg;
+                break;
+
+            case 't': {
+                long value = std::stol(optarg);
+                if (value < 1) {
+                    std::cerr << "The number of threads must be at least 1\n";
+                    exit(EXIT_FAILURE);
+                }
+                numThreads = value;
+            } break;
+
+            case 'T': {
+                std::string type = optarg;
+                if (type == "float") { rawType = DataFormat::Float32; }
+                else if (type == "float16" || type == "half") { rawType = DataFormat::Float16; }
+                else if (type == "bfloat16") { rawType = DataFormat::BFloat16; }
+                else {
+                    std::cerr << "Unknown type '" << type << "'\n";
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+        }
+    }
+
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    const char* filename = argc < 2 ? "data.bin" : argv[1];
+
+    if (!checkpointFile.empty()) {
+        if (rawType != DataFormat::Float32) {
+            std::cerr << "Incremental means are only supported for float values\n";
+            exit(EXIT_FAILURE);
+        }
+        incremental(filename, checkpointFile, follow);
+        return EXIT_SUCCESS;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Compute the mean for the type of values in the file (which is
+    //   recorded in containers, but has to be given for raw files)
+    //
+    switch (DataFormat::elementType(filename, rawType)) {
+        case DataFormat::Float16:
+            mean<Half>(filename, queryFile, numThreads, argc, argv);
+            break;
+
+        case DataFormat::BFloat16:
+            mean<BFloat16>(filename, queryFile, numThreads, argc, argv);
+            break;
+
+        default:
+            mean<float>(filename, queryFile, numThreads, argc, argv);
+            break;
+    }
+}
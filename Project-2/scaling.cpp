@@ -0,0 +1,531 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- scaling.cpp ---
+//
+// A driver for scaling studies (replacing trials.sh, and hand-made
+//   graphs).  It runs a threaded program as a child process for each of a
+//   list of thread counts, several times each, measuring the wall-clock,
+//   user, and system times, and the peak memory use, and then reports
+//
+//   * the speedup, S(n) = T(1) / T(n), and efficiency, S(n) / n
+//   * the Karp-Flatt metric, e(n) = (1/S(n) - 1/n) / (1 - 1/n), the serial
+//       fraction implied by each measurement;  if it grows with n, the
+//       losses are from parallel overhead, not serial work
+//   * a least-squares fit of the execution time to
+//
+//         T(n) = a + b/n + c*n
+//
+//       where a is the serial time, b the perfectly parallel time, and c
+//       the overhead each thread adds (startup, synchronization, and
+//       contention).  The speedup peaks at n = sqrt(b/c), which is where
+//       scaling collapses.
+//
+// In weak-scaling mode (-w), the problem size grows with the thread count
+//   (n * the base size), and Gustafson's scaled speedup, n * T(1) / T(n),
+//   is fit to n - s*(n - 1) for the serial fraction s.
+//
+// The results are written as a CSV file, and an SVG plot of the speedup
+//   (along with the ideal, and fitted, speedups).
+//
+// The command's arguments may contain "{}", replaced by the thread count
+//   (otherwise "-t <threads>" is appended), and "{n}", replaced by the
+//   problem size, e.g.,
+//
+//     scaling.out -n 1:16 -r 5 -o mean -- ./threaded.out -t {} -f data.bin
+//     scaling.out -w 1000000 -o sdf -- ./sdf.out -t {} -n {n}
+//
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Run {
+    double wall;
+    double user;
+    double system;
+    long   memory;   // peak resident set size (in KB)
+};
+
+struct Trial {
+    size_t           threads;
+    std::vector<Run> runs;
+
+    double mean() const {
+        double sum = 0.0;
+        for (auto& run : runs) { sum += run.wall; }
+        return sum / runs.size();
+    }
+
+    double stddev() const {
+        double m = mean();
+        double sum = 0.0;
+        for (auto& run : runs) { sum += (run.wall - m) * (run.wall - m); }
+        return runs.size() > 1 ? std::sqrt(sum / (runs.size() - 1)) : 0.0;
+    }
+
+    double best() const {
+        double t = runs.front().wall;
+        for (auto& run : runs) { t = std::min(t, run.wall); }
+        return t;
+    }
+};
+
+//---------------------------------------------------------------------------
+//
+// parseThreads() - a comma-separated list of thread counts and ranges
+//   (first:last[:step]), e.g., "1,2:84:2"
+//
+std::vector<size_t> parseThreads(const std::string& text) {
+    std::vector<size_t> threads;
+    std::stringstream input(text);
+    for (std::string item; std::getline(input, item, ','); ) {
+        std::vector<size_t> fields;
+        std::stringstream range(item);
+        for (std::string field; std::getline(range, field, ':'); ) {
+            fields.push_back(std::stoul(field));
+        }
+
+        size_t first = fields.at(0);
+        size_t last = fields.size() > 1 ? fields[1] : first;
+        size_t step = fields.size() > 2 ? std::max<size_t>(1, fields[2]) : 1;
+        for (size_t n = first; n <= last; n += step) { threads.push_back(n); }
+    }
+
+    threads.erase(std::remove(threads.begin(), threads.end(), 0), threads.end());
+    return threads;
+}
+
+//---------------------------------------------------------------------------
+//
+// run() - run the command once (with its output discarded), returning its
+//   times and memory use
+//
+Run run(const std::vector<std::string>& command) {
+    std::vector<char*> args;
+    for (auto& arg : command) { args.push_back(const_cast<char*>(arg.c_str())); }
+    args.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execvp(args[0], args.data());
+        perror(args[0]);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        std::cerr << "Unable to run '" << command[0] << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "'" << command[0] << "' failed (status " << status << ")\n";
+        exit(EXIT_FAILURE);
+    }
+
+    return Run{ wall.count(),
+        usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6,
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6,
+        usage.ru_maxrss };
+}
+
+// The command for "threads" threads, and problem size "size"
+std::vector<std::string> instantiate(const std::vector<std::string>& command,
+    size_t threads, size_t size)
+{
+    auto replace = [](std::string arg, const std::string& key, size_t value) {
+        for (size_t p; (p = arg.find(key)) != std::string::npos; ) {
+            arg.replace(p, key.size(), std::to_string(value));
+        }
+        return arg;
+    };
+
+    bool placeholder = false;
+    std::vector<std::string> result;
+    for (auto arg : command) {
+        placeholder |= arg.find("{}") != std::string::npos;
+        result.push_back(replace(replace(arg, "{n}", size), "{}", threads));
+    }
+
+    if (!placeholder) {
+        result.push_back("-t");
+        result.push_back(std::to_string(threads));
+    }
+
+    return result;
+}
+
+//---------------------------------------------------------------------------
+//
+// Model - the least-squares fit of T(n) = a + b/n + c*n.  Each trial is
+//   weighted by 1/T(n)^2, so the fit minimizes the relative error (and
+//   the many fast runs at high thread counts aren't swamped by the slow
+//   ones at low counts).
+//
+struct Model {
+    double a = 0.0;
+    double b = 0.0;
+    double c = 0.0;
+    bool   valid = false;
+
+    double time(double n) const
+        { return a + b / n + c * n; }
+
+    // Serial fraction (of the single-threaded time)
+    double serialFraction() const
+        { return a / time(1.0); }
+
+    // Thread count with the best speedup (if the overhead's positive)
+    double peak() const
+        { return c > 0.0 ? std::sqrt(b / c) : INFINITY; }
+};
+
+Model fit(const std::vector<Trial>& trials) {
+    Model model;
+
+    double M[3][4] = {};
+    for (auto& trial : trials) {
+        double n = trial.threads;
+        double t = trial.mean();
+        double w = 1.0 / (t * t);
+        double x[3] = { 1.0, 1.0 / n, n };
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) { M[i][j] += w * x[i] * x[j]; }
+            M[i][3] += w * x[i] * t;
+        }
+    }
+
+    // Solve the normal equations by Gaussian elimination (with pivoting)
+    for (int col = 0; col < 3; ++col) {
+        int pivot = col;
+        for (int row = col + 1; row < 3; ++row) {
+            if (std::abs(M[row][col]) > std::abs(M[pivot][col])) { pivot = row; }
+        }
+        if (std::abs(M[pivot][col]) < 1e-300) { return model; }
+        std::swap(M[col], M[pivot]);
+
+        for (int row = 0; row < 3; ++row) {
+            if (row == col) { continue; }
+            double f = M[row][col] / M[col][col];
+            for (int k = col; k < 4; ++k) { M[row][k] -= f * M[col][k]; }
+        }
+    }
+
+    model.a = M[0][3] / M[0][0];
+    model.b = M[1][3] / M[1][1];
+    model.c = M[2][3] / M[2][2];
+    model.valid = true;
+
+    return model;
+}
+
+//---------------------------------------------------------------------------
+//
+// plot() - write an SVG graph of the measured speedup, along with the
+//   ideal, and modeled, speedups
+//
+void plot(const std::string& path, const std::string& title,
+    const std::vector<Trial>& trials, const std::vector<double>& speedups,
+    bool weak, const std::vector<double>& model, const std::string& caption)
+{
+    const double width = 720, height = 480;
+    const double left = 70, right = 30, top = 50, bottom = 90;
+
+    double maxThreads = trials.back().threads;
+    double maxSpeedup = 1.0;
+    for (auto s : speedups) { maxSpeedup = std::max(maxSpeedup, s); }
+    for (auto s : model) { maxSpeedup = std::max(maxSpeedup, s); }
+    maxSpeedup *= 1.15;
+
+    auto X = [&](double n) { return left + (width - left - right) * n / maxThreads; };
+    auto Y = [&](double s) { return height - bottom - (height - top - bottom) * s / maxSpeedup; };
+
+    // A "nice" tick spacing, giving about five ticks up to "limit"
+    auto tickStep = [](double limit) {
+        double step = std::pow(10.0, std::floor(std::log10(limit / 5)));
+        for (double m : { 1.0, 2.0, 5.0, 10.0 }) {
+            if (limit / (m * step) <= 8) { return m * step; }
+        }
+        return 10 * step;
+    };
+
+    auto escape = [](const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            switch (c) {
+                case '&': result += "&amp;"; break;
+                case '<': result += "&lt;"; break;
+                case '>': result += "&gt;"; break;
+                default:  result += c;
+            }
+        }
+        return result;
+    };
+
+    std::ofstream svg(path);
+    svg << "<svg xmlns='http://www.w3.org/2000/svg' width='" << width
+        << "' height='" << height << "' font-family='sans-serif' font-size='12'>\n"
+        << "<rect width='100%' height='100%' fill='white'/>\n"
+        << "<defs><clipPath id='plot'><rect x='" << left << "' y='" << top
+        << "' width='" << width - left - right << "' height='" << height - top - bottom
+        << "'/></clipPath></defs>\n"
+        << "<text x='" << width / 2 << "' y='25' text-anchor='middle' font-size='14'>"
+        << escape(title) << "</text>\n";
+
+    for (double x = 0; x <= maxThreads; x += tickStep(maxThreads)) {
+        svg << "<line x1='" << X(x) << "' y1='" << top << "' x2='" << X(x) << "' y2='"
+            << height - bottom << "' stroke='#ddd'/>\n"
+            << "<text x='" << X(x) << "' y='" << height - bottom + 16
+            << "' text-anchor='middle'>" << x << "</text>\n";
+    }
+    for (double y = 0; y <= maxSpeedup; y += tickStep(maxSpeedup)) {
+        svg << "<line x1='" << left << "' y1='" << Y(y) << "' x2='" << width - right
+            << "' y2='" << Y(y) << "' stroke='#ddd'/>\n"
+            << "<text x='" << left - 8 << "' y='" << Y(y) + 4
+            << "' text-anchor='end'>" << y << "</text>\n";
+    }
+
+    svg << "<rect x='" << left << "' y='" << top << "' width='" << width - left - right
+        << "' height='" << height - top - bottom << "' fill='none' stroke='black'/>\n"
+        << "<text x='" << (left + width - right) / 2 << "' y='" << height - bottom + 36
+        << "' text-anchor='middle'>Threads</text>\n"
+        << "<text transform='translate(20," << (top + height - bottom) / 2
+        << ") rotate(-90)' text-anchor='middle'>"
+        << (weak ? "Scaled speedup" : "Speedup") << "</text>\n"
+        << "<text x='" << left << "' y='" << height - 20 << "'>" << caption << "</text>\n";
+
+    auto polyline = [&](const std::vector<double>& values, const char* style) {
+        svg << "<polyline clip-path='url(#plot)' fill='none' " << style << " points='";
+        for (size_t i = 0; i < values.size(); ++i) {
+            svg << X(trials[i].threads) << "," << Y(values[i]) << " ";
+        }
+        svg << "'/>\n";
+    };
+
+    std::vector<double> ideal;
+    for (auto& trial : trials) { ideal.push_back(trial.threads); }
+
+    polyline(ideal, "stroke='#999' stroke-dasharray='6,4'");
+    if (!model.empty()) { polyline(model, "stroke='#d62728' stroke-width='1.5'"); }
+    polyline(speedups, "stroke='#1f77b4' stroke-width='2'");
+    for (size_t i = 0; i < speedups.size(); ++i) {
+        svg << "<circle cx='" << X(trials[i].threads) << "' cy='" << Y(speedups[i])
+            << "' r='3' fill='#1f77b4'/>\n";
+    }
+
+    // Legend
+    struct Entry { const char* label; const char* style; };
+    std::vector<Entry> legend = {
+        { "measured", "stroke='#1f77b4' stroke-width='2'" },
+        { "ideal", "stroke='#999' stroke-dasharray='6,4'" } };
+    if (!model.empty()) {
+        legend.push_back({ weak ? "Gustafson fit" : "fit: a + b/n + c*n",
+            "stroke='#d62728' stroke-width='1.5'" });
+    }
+    for (size_t i = 0; i < legend.size(); ++i) {
+        double y = top + 18 + 18 * i;
+        svg << "<line x1='" << left + 12 << "' y1='" << y << "' x2='" << left + 42
+            << "' y2='" << y << "' " << legend[i].style << "/>\n"
+            << "<text x='" << left + 48 << "' y='" << y + 4 << "'>" << legend[i].label
+            << "</text>\n";
+    }
+
+    svg << "</svg>\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- main ---
+//
+int main(int argc, char* argv[]) {
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string threadList;
+    size_t repetitions = 3;
+    size_t baseSize = 0;   // weak scaling's per-thread problem size
+    std::string prefix = "scaling";
+
+    int option;
+    const char* options = "+hn:o:r:w:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[hnorw] [--] command [args...]\n"
+                    "    -h           show help message\n"
+                    "    -n <list>    thread counts, e.g., 1,2,4 or 1:84:2 (default: powers\n"
+                    "                   of two up to %zu)\n"
+                    "    -o <name>    write <name>.csv and <name>.svg (default: scaling)\n"
+                    "    -r <value>   timed runs per thread count (default: %zu)\n"
+                    "    -w <value>   weak scaling:  problem size {n} is <value> * threads\n"
+                    "\n"
+                    "  In the command, {} is replaced by the thread count (otherwise\n"
+                    "  '-t <threads>' is appended), and {n} by the problem size.\n";
+
+                    fprintf(stderr, help, argv[0], maxThreads, repetitions);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'n':
+                threadList = optarg;
+                break;
+
+            case 'o':
+                prefix = optarg;
+                break;
+
+            case 'r':
+                repetitions = std::max(1l, std::stol(optarg));
+                break;
+
+            case 'w':
+                baseSize = std::stoul(optarg);
+                break;
+        }
+    }
+
+    if (optind >= argc) {
+        std::cerr << "Missing command to run (use -h for help)\n";
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> command(argv + optind, argv + argc);
+    const bool weak = baseSize > 0;
+
+    std::vector<size_t> threads;
+    if (threadList.empty()) {
+        for (size_t n = 1; n < maxThreads; n *= 2) { threads.push_back(n); }
+        threads.push_back(maxThreads);
+    }
+    else {
+        threads = parseThreads(threadList);
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    if (threads.empty() || threads.front() != 1) {
+        std::cerr << "The thread counts need to include 1 (for the baseline)\n";
+        exit(EXIT_FAILURE);
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Run the trials, after an untimed run to warm up the page cache
+    //
+    std::string title;
+    for (auto& arg : command) { title += (title.empty() ? "" : " ") + arg; }
+
+    run(instantiate(command, 1, baseSize));
+
+    std::vector<Trial> trials;
+    for (auto n : threads) {
+        auto instance = instantiate(command, n, baseSize * n);
+
+        Trial trial{ n, {} };
+        for (size_t r = 0; r < repetitions; ++r) { trial.runs.push_back(run(instance)); }
+        trials.push_back(trial);
+
+        std::cerr << "  " << n << " threads: " << trial.mean() << " s\n";
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Compute the speedups and fits, and write the results
+    //
+    const double T1 = trials.front().mean();
+
+    std::vector<double> speedups;
+    for (auto& trial : trials) {
+        double s = T1 / trial.mean();
+        speedups.push_back(weak ? s * trial.threads : s);
+    }
+
+    Model model;
+    double gustafson = 0.0;
+    std::vector<double> modeled;
+
+    if (weak) {
+        // Least-squares fit of n - S(n) = s * (n - 1)
+        double numerator = 0.0, denominator = 0.0;
+        for (size_t i = 0; i < trials.size(); ++i) {
+            double n = trials[i].threads;
+            numerator += (n - speedups[i]) * (n - 1);
+            denominator += (n - 1) * (n - 1);
+        }
+        if (denominator > 0.0) {
+            gustafson = numerator / denominator;
+            for (auto& trial : trials) {
+                modeled.push_back(trial.threads - gustafson * (trial.threads - 1.0));
+            }
+        }
+    }
+    else if (trials.size() >= 3) {
+        model = fit(trials);
+        if (model.valid) {
+            for (auto& trial : trials) { modeled.push_back(T1 / model.time(trial.threads)); }
+        }
+    }
+
+    std::ofstream csv(prefix + ".csv");
+    csv << "threads,size,runs,mean,stddev,best,user,system,memory_kb,speedup,efficiency,"
+        "karp_flatt,model\n";
+    for (size_t i = 0; i < trials.size(); ++i) {
+        auto& trial = trials[i];
+        double n = trial.threads;
+        double user = 0.0, system = 0.0;
+        long memory = 0;
+        for (auto& r : trial.runs) {
+            user += r.user / trial.runs.size();
+            system += r.system / trial.runs.size();
+            memory = std::max(memory, r.memory);
+        }
+
+        double s = speedups[i];
+        double karpFlatt = n > 1 ? (1.0 / s - 1.0 / n) / (1.0 - 1.0 / n) : 0.0;
+
+        csv << trial.threads << "," << baseSize * trial.threads << "," << trial.runs.size()
+            << "," << trial.mean() << "," << trial.stddev() << "," << trial.best()
+            << "," << user << "," << system << "," << memory << "," << s << ","
+            << s / n << "," << karpFlatt << ","
+            << (modeled.empty() ? std::string() : std::to_string(modeled[i])) << "\n";
+    }
+
+    std::stringstream caption;
+    caption.precision(3);
+    if (weak) {
+        caption << "Gustafson serial fraction s = " << gustafson;
+    }
+    else if (model.valid) {
+        caption << "T(n) = " << model.a << " + " << model.b << "/n + " << model.c
+            << "*n s;  serial fraction " << model.serialFraction();
+        if (std::isfinite(model.peak())) {
+            caption << ";  peak speedup at n = " << model.peak();
+        }
+    }
+
+    plot(prefix + ".svg", title, trials, speedups, weak, modeled, caption.str());
+
+    std::cout << (weak ? "Weak" : "Strong") << " scaling of '" << title << "'\n";
+    std::cout << "Maximum speedup = "
+        << *std::max_element(speedups.begin(), speedups.end()) << "\n";
+    if (!caption.str().empty()) { std::cout << caption.str() << "\n"; }
+    std::cout << "Results in " << prefix << ".csv and " << prefix << ".svg\n";
+}
@@ -0,0 +1,634 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- server.cpp ---
+//
+// A long-running query service.  Each run of threaded.out (or sdf.out)
+//   creates its threads, maps its data, and then throws both away, which
+//   for small queries costs more than the query itself.  The server keeps
+//   a pool of worker threads, and a cache of mapped datasets (see
+//   Dataset.h), and answers queries sent to it over a Unix domain socket,
+//   one request per line, with one reply line each:
+//
+//   MEAN <data>                 -> OK count=<n> mean=<m> min=<lo> max=<hi>
+//   RANGE <data> <begin> <end>  -> (the same, over indices [begin, end))
+//   VOLUME <samples> [<seed>]   -> OK samples=<n> volume=<v>
+//   STATS                       -> OK requests=<n> datasets=<n> threads=<n>
+//   QUIT                        (closes the connection)
+//   SHUTDOWN                    (stops the server)
+//
+// <data> is anything threaded.out's -f accepts:  a file (raw floats, or a
+//   container of any type), a directory of shards, or a glob.  A request
+//   that fails is answered with "ERR <message>".  The VOLUME request
+//   estimates the volume sdf.cpp does (the unit cube with the sphere
+//   inscribed in it removed), reproducibly for a given seed.
+//
+// See client.cpp for a load generator.
+//
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+// Header files for the Dataset template class, and the value types
+#include "Dataset.h"
+#include "DataFormat.h"
+#include "Half.h"
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- WorkerPool ---
+//
+// A fixed set of threads that run the tasks of submitted jobs.  run()
+//   splits a job into "numTasks" tasks, which the workers claim from an
+//   atomic counter (like Dataset's Scheduler), and returns once they've
+//   all finished.  Jobs from several connections may be queued;  a worker
+//   moves to the next job once every task of the current one is claimed.
+//   Each task is passed the index of the worker running it, so jobs can
+//   keep per-worker state without locking.
+//
+class WorkerPool {
+    using Task = std::function<void(size_t task, size_t worker)>;
+
+    struct Job {
+        const Task&          task;
+        size_t               numTasks;
+        std::atomic<size_t>  next{0};
+        std::atomic<size_t>  done{0};
+        std::exception_ptr   error;
+
+        std::mutex               mutex;
+        std::condition_variable  finished;
+
+        Job(const Task& task, size_t numTasks) : task(task), numTasks(numTasks) {}
+    };
+
+    std::mutex                        _mutex;
+    std::condition_variable_any       _ready;
+    std::deque<std::shared_ptr<Job>>  _jobs;
+
+    // (last, so the threads are stopped before the rest is destroyed)
+    std::vector<std::jthread>         _threads;
+
+    void work(std::stop_token stop, size_t worker) {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock lock(_mutex);
+                if (!_ready.wait(lock, stop, [&]() { return !_jobs.empty(); })) {
+                    return;
+                }
+                job = _jobs.front();
+            }
+
+            for (size_t task; (task = job->next++) < job->numTasks; ) {
+                try {
+                    job->task(task, worker);
+                }
+                catch (...) {
+                    std::lock_guard lock(job->mutex);
+                    if (!job->error) { job->error = std::current_exception(); }
+                }
+
+                if (++job->done == job->numTasks) {
+                    std::lock_guard lock(job->mutex);
+                    job->finished.notify_all();
+                }
+            }
+
+            std::lock_guard lock(_mutex);
+            if (!_jobs.empty() && _jobs.front() == job) { _jobs.pop_front(); }
+        }
+    }
+
+  public:
+    explicit WorkerPool(size_t numThreads) {
+        for (size_t id = 0; id < std::max<size_t>(1, numThreads); ++id) {
+            _threads.emplace_back([this, id](std::stop_token stop) { work(stop, id); });
+        }
+    }
+
+    size_t size() const
+        { return _threads.size(); }
+
+    // Run the tasks, rethrowing the first exception any of them threw
+    void run(size_t numTasks, const Task& task) {
+        if (numTasks == 0) { return; }
+
+        auto job = std::make_shared<Job>(task, numTasks);
+        {
+            std::lock_guard lock(_mutex);
+            _jobs.push_back(job);
+        }
+        _ready.notify_all();
+
+        std::unique_lock lock(job->mutex);
+        job->finished.wait(lock, [&]() { return job->done == job->numTasks; });
+
+        if (job->error) { std::rethrow_exception(job->error); }
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Source ---
+//
+// A cached dataset, of whichever type its values are, along with the
+//   index of the first value of each of its work units (so a range of
+//   indices can be mapped to the units covering it).  Once a dataset's
+//   been cached for a while, its shards are listed, and stat()ed, again
+//   the next time it's requested, so a dataset that's changed since it was
+//   opened (a shard added, removed, or modified) is noticed, and reopened.
+//
+template <typename Type>
+struct Source {
+    Dataset<Type>        dataset;
+    std::vector<size_t>  starts;
+
+    Source(const std::string& pattern, size_t maxOpen) : dataset(pattern, maxOpen) {
+        size_t start = 0;
+        for (size_t i = 0; i < dataset.numUnits(); ++i) {
+            starts.push_back(start);
+            start += dataset.unit(i).end - dataset.unit(i).begin;
+        }
+    }
+};
+
+using AnySource = std::variant<Source<float>, Source<Half>, Source<BFloat16>>;
+
+// The identity of a shard, as of when its dataset was opened
+struct FileStamp {
+    std::string path;
+    int64_t     modified;   // in nanoseconds (-1 if it couldn't be stat()ed)
+    uint64_t    size;
+
+    bool operator == (const FileStamp&) const = default;
+};
+
+// The stamps of all of the shards named by "pattern"
+std::vector<FileStamp> stamp(const std::string& pattern) {
+    std::vector<FileStamp> stamps;
+    for (auto& path : Dataset<float>::list(pattern)) {
+        struct stat info;
+        if (stat(path.c_str(), &info) == -1) {
+            stamps.push_back({ path, -1, 0 });
+        }
+        else {
+            stamps.push_back({ path,
+                int64_t(info.st_mtim.tv_sec) * 1'000'000'000 + info.st_mtim.tv_nsec,
+                uint64_t(info.st_size) });
+        }
+    }
+    return stamps;
+}
+
+using Clock = std::chrono::steady_clock;
+
+struct CacheEntry {
+    std::shared_ptr<AnySource>  source;
+    std::vector<FileStamp>      stamps;
+    Clock::time_point           checked;    // when the stamps were taken
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- Service ---
+//
+// Answers requests, using the worker pool, and a cache of (at most
+//   "cacheSize") open datasets, least recently used first out, which are
+//   checked for changes at most every "recheck" seconds
+//
+class Service {
+    WorkerPool  _pool;
+    size_t      _cacheSize;
+    std::chrono::duration<double> _recheck;
+
+    std::mutex                         _mutex;
+    std::map<std::string, CacheEntry>  _cache;
+    std::list<std::string>             _recent;
+
+    std::atomic<uint64_t>  _requests{0};
+
+    //-----------------------------------------------------------------------
+    //
+    // open() - the dataset named by "pattern", from the cache if it's there
+    //   and its shards are unchanged.  Stamping a dataset lists its shards
+    //   (for a directory, opening each of them;  see Dataset::list()), and
+    //   stat()s them, so a cached dataset is only re-stamped once its
+    //   stamps are older than _recheck.  Stamping, and opening, a dataset
+    //   (which maps, and sizes, each of its shards) are done without
+    //   holding the lock, so two requests for the same new dataset may both
+    //   open it (the first one cached is kept).
+    //
+    std::shared_ptr<AnySource> open(const std::string& pattern) {
+        // Return the cached dataset, if "valid", moving it to the front
+        //   (the lock must be held)
+        auto lookup = [&](auto valid) -> std::shared_ptr<AnySource> {
+            auto cached = _cache.find(pattern);
+            if (cached == _cache.end() || !valid(cached->second)) { return nullptr; }
+
+            _recent.remove(pattern);
+            _recent.push_front(pattern);
+            return cached->second.source;
+        };
+
+        Clock::time_point now = Clock::now();
+        {
+            std::lock_guard lock(_mutex);
+            auto source = lookup([&](const CacheEntry& entry)
+                { return now - entry.checked < _recheck; });
+            if (source) { return source; }
+        }
+
+        std::vector<FileStamp> stamps = stamp(pattern);
+
+        {
+            std::lock_guard lock(_mutex);
+            auto source = lookup([&](CacheEntry& entry) {
+                if (entry.stamps != stamps) { return false; }
+                entry.checked = now;
+                return true;
+            });
+            if (source) { return source; }
+        }
+
+        // Enough shards can stay mapped for each worker to hold one
+        size_t maxOpen = std::max(_pool.size(), Dataset<float>::DefaultMaxOpen);
+
+        std::shared_ptr<AnySource> source;
+        std::vector<std::string> paths;
+        for (auto& shard : stamps) { paths.push_back(shard.path); }
+
+        switch (Dataset<float>::elementType(paths, DataFormat::Float32)) {
+            case DataFormat::Float16:
+                source = std::make_shared<AnySource>(std::in_place_type<Source<Half>>,
+                    pattern, maxOpen);
+                break;
+
+            case DataFormat::BFloat16:
+                source = std::make_shared<AnySource>(std::in_place_type<Source<BFloat16>>,
+                    pattern, maxOpen);
+                break;
+
+            default:
+                source = std::make_shared<AnySource>(std::in_place_type<Source<float>>,
+                    pattern, maxOpen);
+                break;
+        }
+
+        std::lock_guard lock(_mutex);
+
+        auto cached = _cache.find(pattern);
+        if (cached != _cache.end()) {
+            _recent.remove(pattern);
+            if (cached->second.stamps == stamps) {
+                _recent.push_front(pattern);
+                return cached->second.source;
+            }
+            _cache.erase(cached);
+        }
+
+        while (_cache.size() >= _cacheSize && !_recent.empty()) {
+            _cache.erase(_recent.back());
+            _recent.pop_back();
+        }
+
+        _cache[pattern] = CacheEntry{ source, std::move(stamps), now };
+        _recent.push_front(pattern);
+
+        return source;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // aggregate() - the count, sum, and extremes of the values with indices
+    //   in [begin, end), computed by the workers a unit at a time.  Each
+    //   worker reads through its own Reader, and accumulates into its own
+    //   Aggregate, which are merged once all the units are done.
+    //
+    template <typename Type>
+    DataFormat::Aggregate aggregate(Source<Type>& source, size_t begin, size_t end) {
+        auto& dataset = source.dataset;
+        auto& starts = source.starts;
+
+        end = std::min(end, dataset.size());
+        if (begin >= end) { return {}; }
+
+        // Containers summarize every block, so the whole dataset's
+        //   aggregate needs no reading
+        if (begin == 0 && end == dataset.size() && dataset.hasSummaries()) {
+            return dataset.aggregate();
+        }
+
+        // The units covering [begin, end)
+        size_t first = std::upper_bound(starts.begin(), starts.end(), begin)
+            - starts.begin() - 1;
+        size_t last = std::lower_bound(starts.begin(), starts.end(), end)
+            - starts.begin();
+
+        std::vector<DataFormat::Aggregate>          partial(_pool.size());
+        std::vector<typename Dataset<Type>::Reader> readers(_pool.size());
+
+        _pool.run(last - first, [&](size_t task, size_t worker) {
+            size_t index = first + task;
+            auto [values, valuesEnd] = dataset.read(dataset.unit(index), readers[worker]);
+
+            size_t lo = std::max(begin, starts[index]) - starts[index];
+            size_t hi = std::min<size_t>(end - starts[index], valuesEnd - values);
+            partial[worker].add(values + lo, values + hi);
+        });
+
+        DataFormat::Aggregate result;
+        for (auto& p : partial) { result += p; }
+
+        return result;
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // volume() - estimate sdf.cpp's volume from "numSamples" random points.
+    //   The points are generated in fixed-size chunks, each with its own
+    //   generator seeded from the seed and the chunk's index (as
+    //   generate.cpp does), so the estimate doesn't depend on the number
+    //   of workers.
+    //
+    double volume(size_t numSamples, uint64_t seed) {
+        const size_t chunkSize = 1 << 16;
+        size_t numChunks = (numSamples + chunkSize - 1) / chunkSize;
+
+        std::vector<size_t> outside(_pool.size());
+
+        _pool.run(numChunks, [&](size_t chunk, size_t worker) {
+            std::seed_seq sequence{ uint32_t(seed), uint32_t(seed >> 32),
+                uint32_t(chunk), uint32_t(uint64_t(chunk) >> 32) };
+            std::mt19937_64 generator(sequence);
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+            // The sphere centered in the unit cube, with radius 0.5
+            size_t n = std::min(chunkSize, numSamples - chunk * chunkSize);
+            size_t count = 0;
+            for (size_t i = 0; i < n; ++i) {
+                double x = uniform(generator) - 0.5;
+                double y = uniform(generator) - 0.5;
+                double z = uniform(generator) - 0.5;
+                count += x*x + y*y + z*z > 0.25;
+            }
+            outside[worker] += count;
+        });
+
+        size_t total = 0;
+        for (auto count : outside) { total += count; }
+
+        return numSamples ? double(total) / numSamples : 0.0;
+    }
+
+    static std::string reply(const DataFormat::Aggregate& a) {
+        std::stringstream output;
+        output << std::setprecision(10) << "OK count=" << a.count << " mean=" << a.mean();
+        if (a.count) { output << " min=" << a.min << " max=" << a.max; }
+        return output.str();
+    }
+
+  public:
+    Service(size_t numThreads, size_t cacheSize, double recheck) :
+        _pool(numThreads), _cacheSize(std::max<size_t>(1, cacheSize)),
+        _recheck(recheck) {}
+
+    //-----------------------------------------------------------------------
+    //
+    // handle() - answer a request line (see the top of the file)
+    //
+    std::string handle(const std::string& line) {
+        ++_requests;
+
+        std::stringstream request(line);
+        std::string command;
+        request >> command;
+
+        try {
+            if (command == "MEAN" || command == "RANGE") {
+                std::string pattern;
+                size_t begin = 0;
+                size_t end = SIZE_MAX;
+
+                request >> pattern;
+                if (command == "RANGE") { request >> begin >> end; }
+                if (!request) { return "ERR usage: " + command +
+                    (command == "MEAN" ? " <data>" : " <data> <begin> <end>"); }
+
+                auto source = open(pattern);
+                return std::visit([&](auto& s) { return reply(aggregate(s, begin, end)); },
+                    *source);
+            }
+
+            if (command == "VOLUME") {
+                size_t numSamples;
+                uint64_t seed = 1;
+                if (!(request >> numSamples)) { return "ERR usage: VOLUME <samples> [<seed>]"; }
+                request >> seed;
+
+                std::stringstream output;
+                output << std::setprecision(10) << "OK samples=" << numSamples
+                    << " volume=" << volume(numSamples, seed);
+                return output.str();
+            }
+
+            if (command == "STATS") {
+                std::lock_guard lock(_mutex);
+                std::stringstream output;
+                output << "OK requests=" << _requests << " datasets=" << _cache.size()
+                    << " threads=" << _pool.size();
+                return output.str();
+            }
+        }
+        catch (const std::exception& e) {
+            return std::string("ERR ") + e.what();
+        }
+
+        return "ERR unknown request '" + command + "'";
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- serve() ---
+//
+// Answer the requests on a connection until the client closes it (or
+//   sends QUIT).  Returns true if the client asked the server to shut down.
+//
+bool serve(int fd, Service& service) {
+    std::string pending;
+    char buffer[4096];
+
+    while (true) {
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+            if (line.empty()) { continue; }
+
+            if (line == "QUIT") { return false; }
+            if (line == "SHUTDOWN") {
+                send(fd, "OK\n", 3, MSG_NOSIGNAL);
+                return true;
+            }
+
+            std::string response = service.handle(line) + "\n";
+            for (size_t sent = 0; sent < response.size(); ) {
+                ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                    MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR) { continue; }
+                    return false;
+                }
+                sent += n;
+            }
+        }
+
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        pending.append(buffer, n);
+    }
+}
+
+// The socket's path, for removing it when interrupted
+const char* socketPath = nullptr;
+
+extern "C" void interrupted(int) {
+    if (socketPath) { unlink(socketPath); }
+    _exit(EXIT_SUCCESS);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- main ---
+//
+int main(int argc, char* argv[]) {
+    std::string path = "stats.sock";
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t cacheSize = 16;
+    double recheck = 1.0;
+
+    int option;
+    const char* options = "c:hr:s:t:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[chrst]\n"
+                    "    -h           show help message\n"
+                    "    -c <value>   keep up to <value> datasets open (default: %zu)\n"
+                    "    -r <value>   check open datasets for changes at most every\n"
+                    "                   <value> seconds (default: %g)\n"
+                    "    -s <name>    listen on the Unix domain socket <name>\n"
+                    "                   (default: %s)\n"
+                    "    -t <value>   use <value> worker threads (default: %zu)\n";
+
+                    fprintf(stderr, help, argv[0], cacheSize, recheck, path.c_str(),
+                        numThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'c':
+                cacheSize = std::stol(optarg);
+                break;
+
+            case 'r':
+                recheck = std::stod(optarg);
+                break;
+
+            case 's':
+                path = optarg;
+                break;
+
+            case 't':
+                numThreads = std::stol(optarg);
+                break;
+        }
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path '" << path << "' is too long\n";
+        exit(EXIT_FAILURE);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    // Remove a socket left behind by a previous server (but nothing else)
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address),
+            sizeof(address)) == -1 || listen(listener, 128) == -1)
+    {
+        std::cerr << "Unable to listen on '" << path << "': " << strerror(errno) << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    socketPath = path.c_str();
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+    signal(SIGPIPE, SIG_IGN);
+
+    Service service(numThreads, cacheSize, recheck);
+    std::cerr << "Listening on " << path << " (" << numThreads << " threads)\n";
+
+    //-----------------------------------------------------------------------
+    //
+    // Each connection is served by its own thread, which hands the work
+    //   of its requests to the shared worker pool
+    //
+    std::atomic<bool> shutdown{false};
+
+    while (!shutdown) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            break;
+        }
+
+        std::thread([fd, &service, &shutdown, listener]() {
+            if (serve(fd, service)) {
+                shutdown = true;
+                ::shutdown(listener, SHUT_RDWR);
+            }
+            close(fd);
+        }).detach();
+    }
+
+    unlink(path.c_str());
+    std::cerr << "Shutting down\n";
+
+    // Connections may still be open (and using the service), so exit
+    //   without destroying it
+    std::quick_exit(EXIT_SUCCESS);
+}
@@ -1,70 +1,145 @@
 
 #include <barrier>
+#include <cstdio>
 #include <iostream>
 #include <numeric>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
-// Header file for the Data template class
+#include <unistd.h>
+
+// Header files for the Data and Dataset template classes
 #include "Data.h"
+#include "Dataset.h"
+#include "Half.h"
+#include "Statistics.h"
+
+// The statistics selected on the command line (see main())
+struct Options {
+    bool    variance = false;
+    bool    extremes = false;
+    size_t  numBins = 0;
+    bool    optionalHistogram = false;  // (from -a) skipped if there's no range
+    double  lo = 0.0;
+    double  hi = 0.0;
+    bool    haveRange = false;
+    std::vector<double> quantiles;
+};
 
 /////////////////////////////////////////////////////////////////////////////
 //
-// --- main ---
+// --- Accumulator ---
 //
-int main(int argc, char* argv[]) {
-    //
-    // Specify the program's default options:
-    //   * the default filename
-    //   * the default number of threads
-    //
-    std::string filename = "data.bin";
-    size_t numThreads = 4;
+// The statistics a thread accumulates over its part of the data.  Which
+//   statistics are computed is selected from the command line;  the mean
+//   is always computed.  Each thread walks its data once, a chunk at a
+//   time, running each selected statistic over the chunk while it's in
+//   cache, so the data is only read from memory (or disk) once no matter
+//   how many statistics are requested.  Reduced-precision values (see
+//   Half.h) are widened to floats a chunk at a time, as they're read.
+//
+struct Accumulator {
+    static constexpr size_t ChunkSize = 4096;
 
-    //-----------------------------------------------------------------------
-    //
-    // Process command-line options.  Accepted options are specified in the
-    //   character string "options".  All options are single characters
-    //   (as compared to full words like some programs).  If a character
-    //   is followed by a color (:), the option expects an additional
-    //   parameter.
-    //
-    // Options are processed using a simple library function getopt()
-    //
-    int option;
-    const char* options = "f:ht:";
-    while ((option = getopt(argc, argv, options)) != -1) {
-        switch (option) {
-            case 'h': {
-                const char* help =
-                    "Usage: %s -[fht]\n"
-                    "    -h           show help message\n"
-                    "    -f <name>    read data from <name>\n"
-                    "    -t <value>   use <values> number of threads (default: %u)\n";
+    const Options&  options;
+    uint64_t        count = 0;
+    double          sum = 0.0;
+    RunningStats    stats;
+    Histogram       histogram;
+    QuantileSketch  sketch;
 
-                    fprintf(stderr, help, argv[0], numThreads);
-                    exit(EXIT_SUCCESS);
-            } break;
+    Accumulator(const Options& options, unsigned seed = 1) :
+        options(options), histogram(options.numBins, options.lo, options.hi),
+        sketch(256, seed) {}
 
-            case 'f':
-                filename = optarg;
-                break;
+    void add(const float* begin, const float* end) {
+        count += end - begin;
 
-            case 't':
-                numThreads = std::stol(optarg);
-                break;
+        for (auto chunk = begin; chunk < end; chunk += ChunkSize) {
+            auto chunkEnd = std::min(end, chunk + ChunkSize);
+
+            if (options.variance || options.extremes) {
+                stats.add(chunk, chunkEnd);
+            }
+            else {
+                for (auto p = chunk; p != chunkEnd; ++p) { sum += *p; }
+            }
+
+            if (options.numBins > 0) { histogram.add(chunk, chunkEnd); }
+            if (!options.quantiles.empty()) { sketch.add(chunk, chunkEnd); }
         }
     }
 
+    template <typename T>
+    void add(const T* begin, const T* end) {
+        float values[ChunkSize];
+        for (auto chunk = begin; chunk < end; chunk += ChunkSize) {
+            size_t n = std::min<size_t>(ChunkSize, end - chunk);
+            widen(chunk, values, n);
+            add(values, values + n);
+        }
+    }
+
+    void merge(const Accumulator& a) {
+        count += a.count;
+        sum += a.sum;
+        stats.merge(a.stats);
+        if (options.numBins > 0) { histogram.merge(a.histogram); }
+        if (!options.quantiles.empty()) { sketch.merge(a.sketch); }
+    }
+
+    double mean() const
+        { return stats.count ? stats.mean : count ? sum / count : 0.0; }
+};
+
+// Parse a comma-separated list of numbers (e.g., "0.5,0.9,0.99")
+std::vector<double> parseList(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream input(text);
+    for (std::string value; std::getline(input, value, ','); ) {
+        values.push_back(std::stod(value));
+    }
+    return values;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- accumulate ---
+//
+// Compute the statistics selected in "stats" over the values (of type
+//   "Type") in "filename", using "numThreads" threads
+//
+template <typename Type>
+Accumulator accumulate(const std::string& filename, size_t numThreads, Options& stats) {
     //-----------------------------------------------------------------------
     //
-    // Access our the data file through our Data C++ class.  Under the hood,
-    //   this class uses an advanced file-access technique called memory
-    //   mapping, which makes the file looked like an array (although our
-    //   Data class makes it look more like a std::vector), allowing indexed
-    //   random-access to the data.
+    // Access the data through our Dataset C++ class, which presents one or
+    //   more data files (each accessed through our Data class, which memory
+    //   maps the file, making it look like an array) as one sequence of
+    //   values, divided into work units of similar size.  Enough shards
+    //   can stay mapped for each thread to hold one.
     //
-    Data<float>  data(filename.c_str());
+    Dataset<Type>  data(filename, std::max(numThreads, Dataset<Type>::DefaultMaxOpen));
+
+    // A histogram's range needs to be known before the data's read.
+    //   Containers record the extremes of each block, so we can get it
+    //   from those without reading the data.  (-a only asks for a
+    //   histogram if one's possible.)
+    if (stats.numBins > 0 && !stats.haveRange && !data.hasSummaries()) {
+        if (!stats.optionalHistogram) {
+            std::cerr << "A histogram of a raw data file needs a range (-r)\n";
+            exit(EXIT_FAILURE);
+        }
+        stats.numBins = 0;
+    }
+
+    if (stats.numBins > 0 && !stats.haveRange) {
+        auto aggregate = data.aggregate();
+        stats.lo = aggregate.min;
+        stats.hi = aggregate.max > aggregate.min ? aggregate.max : aggregate.min + 1.0;
+    }
 
     //-----------------------------------------------------------------------
     //
@@ -72,17 +147,22 @@ int main(int argc, char* argv[]) {
     //
     //   * threads - is merely an array of std::jthreads to store the created
     //       threads, similar to what was demonstrated in class
-    //   * sums - provides a per-thread sum allowing you to accumulate the
-    //       values computed in a thread independent of other threads
+    //   * accumulators - provides per-thread statistics allowing you to
+    //       accumulate the values computed in a thread independent of
+    //       other threads
     //   * barrier - provides a synchronization barrier to prevent threads
     //       exiting before their peers
     //
     std::vector<std::jthread>  threads(numThreads);
-    std::vector<double>        sums(numThreads);
+    std::vector<Accumulator>   accumulators;
+    for (size_t id = 0; id < numThreads; ++id) {
+        accumulators.emplace_back(stats, id + 1);
+    }
     std::barrier               barrier(numThreads);
 
-    // Computation of how much work a thread should do.
-    size_t chunkSize = (data.size() / numThreads) + 1;
+    // Work is handed out a unit at a time, so threads that finish early
+    //   take on more
+    typename Dataset<Type>::Scheduler  scheduler(data);
 
     //-----------------------------------------------------------------------
     //
@@ -97,23 +177,19 @@ int main(int argc, char* argv[]) {
     for (size_t id = 0; id < threads.size(); ++id) {
     threads[id] = std::jthread(
         [&, id]() {
-            // Compute this thread's chunk of the data
-            size_t begin = id * chunkSize;
-            size_t end   = begin + chunkSize;
-            if (end > data.size()) {
-                end = data.size();
-            }
+            // Accumulate the statistics of each unit this thread claims
+            //   into its slot.  Compressed units are decoded into the
+            //   reader's scratch space, and reduced while still in cache.
+            typename Dataset<Type>::Unit   unit;
+            typename Dataset<Type>::Reader reader;
 
-            // Thread-local sum
-            double localSum = 0.0;
-            for (size_t i = begin; i < end; ++i) {
-                localSum += data[i];
+            while (scheduler.next(unit)) {
+                auto [begin, end] = data.read(unit, reader);
+                accumulators[id].add(begin, end);
             }
+            reader = {};
 
-            // Store into this thread's slot
-            sums[id] = localSum;
-
-            // Wait for all threads to finish their sums
+            // Wait for all threads to finish their statistics
             barrier.arrive_and_wait();
         }
     );
@@ -129,11 +205,181 @@ int main(int argc, char* argv[]) {
 
     //-----------------------------------------------------------------------
     //
-    // Compute the final sum by tallying the values from each thread, and
-    //   report the results
+    // Compute the final statistics by merging the values from each
+    //   thread
+    //
+    Accumulator result(stats);
+    for (auto& accumulator : accumulators) {
+        result.merge(accumulator);
+    }
+
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// --- main ---
+//
+int main(int argc, char* argv[]) {
+    //
+    // Specify the program's default options:
+    //   * the default filename
+    //   * the default number of threads
+    //
+    std::string filename = "data.bin";
+    size_t numThreads = 4;
+    uint32_t rawType = DataFormat::Float32;
+    Options stats;
+
+    //-----------------------------------------------------------------------
+    //
+    // Process command-line options.  Accepted options are specified in the
+    //   character string "options".  All options are single characters
+    //   (as compared to full words like some programs).  If a character
+    //   is followed by a color (:), the option expects an additional
+    //   parameter.
+    //
+    // Options are processed using a simple library function getopt()
+    //
+    int option;
+    const char* options = "af:hH:p:r:t:T:vx";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[afhHprtTvx]\n"
+                    "    -h           show help message\n"
+                    "    -f <name>    read data from <name>: a file (raw, container, or\n"
+                    "                   compressed), a directory of shards, or a quoted\n"
+                    "                   glob (e.g., 'shards/*.bin')\n"
+                    "    -t <value>   use <values> number of threads (default: %u)\n"
+                    "    -T <type>    type of a raw file's values: float, float16, or\n"
+                    "                   bfloat16 (default: float)\n"
+                    "\n"
+                    "  Statistics (the sample count and mean are always reported):\n"
+                    "    -a           all of the below that apply (10 bins, if there's\n"
+                    "                   a range, and quartiles)\n"
+                    "    -v           variance and standard deviation\n"
+                    "    -x           minimum and maximum\n"
+                    "    -H <value>   histogram with <value> bins\n"
+                    "    -r <lo,hi>   histogram range (default: the data's extremes\n"
+                    "                   from a container's summaries)\n"
+                    "    -p <list>    approximate quantiles (e.g., 0.5,0.9,0.99)\n";
+
+                    fprintf(stderr, help, argv[0], numThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'a':
+                stats.variance = stats.extremes = true;
+                if (stats.numBins == 0) {
+                    stats.numBins = 10;
+                    stats.optionalHistogram = true;
+                }
+                if (stats.quantiles.empty()) { stats.quantiles = { 0.25, 0.5, 0.75 }; }
+                break;
+
+            case 'H':
+                stats.numBins = std::stol(optarg);
+                stats.optionalHistogram = false;
+                break;
+
+            case 'p':
+                stats.quantiles = parseList(optarg);
+                break;
+
+            case 'r': {
+                auto range = parseList(optarg);
+                if (range.size() != 2 || !(range[0] < range[1])) {
+                    std::cerr << "Invalid histogram range '" << optarg << "'\n";
+                    exit(EXIT_FAILURE);
+                }
+                stats.lo = range[0];
+                stats.hi = range[1];
+                stats.haveRange = true;
+            } break;
+
+            case 'v':
+                stats.variance = true;
+                break;
+
+            case 'x':
+                stats.extremes = true;
+                break;
+
+            case 'f':
+                filename = optarg;
+                break;
+
+            case 't':
+                numThreads = std::stol(optarg);
+                break;
+
+            case 'T': {
+                std::string type = optarg;
+                if (type == "float") { rawType = DataFormat::Float32; }
+                else if (type == "float16" || type == "half") { rawType = DataFormat::Float16; }
+                else if (type == "bfloat16") { rawType = DataFormat::BFloat16; }
+                else {
+                    std::cerr << "Unknown type '" << type << "'\n";
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+    //
+    // Compute the statistics, for the type of values in the file (which
+    //   is recorded in containers, but has to be given for raw files)
+    //
+    uint32_t type = Dataset<float>::elementType(Dataset<float>::list(filename), rawType);
+
+    Accumulator result =
+        type == DataFormat::Float16  ? accumulate<Half>(filename, numThreads, stats) :
+        type == DataFormat::BFloat16 ? accumulate<BFloat16>(filename, numThreads, stats) :
+        accumulate<float>(filename, numThreads, stats);
+
+    //-----------------------------------------------------------------------
     //
-    double sum = std::accumulate(std::begin(sums), std::end(sums), 0.0);
+    // Report the results
+    //
+    std::cout << "Samples = " << result.count << "\n";
+    std::cout << "Mean = " << result.mean() << "\n";
+
+    if (stats.variance) {
+        std::cout << "Variance = " << result.stats.sampleVariance() << "\n";
+        std::cout << "Std. deviation = " << std::sqrt(result.stats.sampleVariance()) << "\n";
+    }
+
+    if (stats.extremes) {
+        std::cout << "Min = " << result.stats.min << "\n";
+        std::cout << "Max = " << result.stats.max << "\n";
+    }
 
-    std::cout << "Samples = " << data.size() << "\n";
-    std::cout << "Mean = " << sum / data.size() << "\n";
+    for (auto q : stats.quantiles) {
+        std::cout << "Quantile " << q << " = " << result.sketch.quantile(q) << "\n";
+    }
+    if (!stats.quantiles.empty() && result.sketch.nans()) {
+        std::cout << "Quantiles exclude " << result.sketch.nans() << " NaNs\n";
+    }
+
+    if (stats.numBins > 0) {
+        const auto& histogram = result.histogram;
+        std::cout << "Histogram:\n";
+        if (histogram.underflow) {
+            std::cout << "  < " << histogram.lo << ": " << histogram.underflow << "\n";
+        }
+        for (size_t i = 0; i < histogram.bins.size(); ++i) {
+            double lo = histogram.lo + i * histogram.binWidth();
+            std::cout << "  [" << lo << ", " << lo + histogram.binWidth() << "): "
+                << histogram.bins[i] << "\n";
+        }
+        if (histogram.overflow) {
+            std::cout << "  > " << histogram.hi << ": " << histogram.overflow << "\n";
+        }
+        if (histogram.nans) {
+            std::cout << "  NaN: " << histogram.nans << "\n";
+        }
+    }
 }
@@ -1,5 +1,9 @@
 #! /usr/bin/env bash
 
+# (scaling.out runs trials like these, and also computes the speedups, fits
+#   the serial fraction and threading overhead, and plots the results;
+#   e.g., ./scaling.out -n 1,2:84:2 -o mean -- ./threaded.out -t {} -f data.bin)
+
 # Number of samples for sdf.out trials
 SAMPLES=1000000000
 
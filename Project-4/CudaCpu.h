@@ -0,0 +1,311 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  CudaCpu.h
+//
+//  A minimal CPU execution backend for our CUDA programs, so the same
+//    kernel source can be built, run, and benchmarked on machines without
+//    an NVIDIA GPU (see the "%-cuda.cpu" rule in the Makefile).
+//
+//  It provides:
+//
+//  - the __global__, __host__, and __device__ decorations (which do nothing
+//      on the CPU)
+//
+//  - dim3, along with per-thread blockIdx, threadIdx, blockDim, and
+//      gridDim variables, set up for each (CUDA) thread a kernel executes
+//
+//  - the CUDA runtime functions our programs use (cudaMalloc(),
+//      cudaMemcpy(), cudaGetLastError(), etc.), implemented with host
+//      memory, so CUDA_CHECK_CALL() and CUDA_CHECK_KERNEL() from
+//      CudaCheck.h work unchanged
+//
+//  - cudaCpuLaunch(), which replaces a kernel dispatch.  The C++ compiler
+//      doesn't understand CUDA's launch syntax, so the Makefile rewrites
+//
+//        kernel<<<numBlocks, blockDim>>>(args ...)
+//
+//      into
+//
+//        cudaCpuLaunch(kernel, numBlocks, blockDim)(args ...)
+//
+//      which runs the kernel over the grid on a pool of CPU threads.  Each
+//      CPU thread takes whole blocks at a time (much like a streaming
+//      multiprocessor), and executes the block's CUDA threads one after
+//      the other.  As such, kernels using __syncthreads() or shared memory
+//      aren't supported.
+//
+//  Launches are synchronous, which is indistinguishable from a GPU launch
+//    followed by the cudaMemcpy() (which synchronizes) in our programs.
+//
+
+#ifndef __CUDACPU_H__
+#define __CUDACPU_H__
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#define __global__
+#define __host__
+#define __device__
+
+//----------------------------------------------------------------------------
+//
+//  Grid and block indexing
+//
+
+struct uint3 {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int z = 0;
+};
+
+struct dim3 {
+    unsigned int x;
+    unsigned int y;
+    unsigned int z;
+
+    dim3(unsigned int x = 1, unsigned int y = 1, unsigned int z = 1)
+        : x(x), y(y), z(z) {}
+
+    size_t count() const { return size_t(x) * y * z; }
+};
+
+inline thread_local uint3 blockIdx;
+inline thread_local uint3 threadIdx;
+inline thread_local dim3  blockDim;
+inline thread_local dim3  gridDim;
+
+//----------------------------------------------------------------------------
+//
+//  Runtime errors
+//
+
+enum cudaError_t {
+    cudaSuccess = 0,
+    cudaErrorInvalidValue,
+    cudaErrorMemoryAllocation,
+    cudaErrorInvalidConfiguration,
+    cudaErrorLaunchFailure
+};
+
+inline const char* cudaGetErrorString(cudaError_t error) {
+    switch (error) {
+        case cudaSuccess:                   return "no error";
+        case cudaErrorInvalidValue:         return "invalid argument";
+        case cudaErrorMemoryAllocation:     return "out of memory";
+        case cudaErrorInvalidConfiguration: return "invalid configuration argument";
+        case cudaErrorLaunchFailure:        return "unspecified launch failure";
+    }
+
+    return "unrecognized error code";
+}
+
+inline std::atomic<cudaError_t> cudaCpuLastError{cudaSuccess};
+
+inline cudaError_t cudaGetLastError()
+    { return cudaCpuLastError.exchange(cudaSuccess); }
+
+inline cudaError_t cudaPeekAtLastError()
+    { return cudaCpuLastError.load(); }
+
+inline cudaError_t cudaDeviceSynchronize()
+    { return cudaSuccess; }
+
+//----------------------------------------------------------------------------
+//
+//  Memory management (device memory is just host memory)
+//
+
+enum cudaMemcpyKind {
+    cudaMemcpyHostToHost,
+    cudaMemcpyHostToDevice,
+    cudaMemcpyDeviceToHost,
+    cudaMemcpyDeviceToDevice,
+    cudaMemcpyDefault
+};
+
+template <typename T>
+cudaError_t cudaMalloc(T** pointer, size_t numBytes) {
+    if (!pointer) { return cudaErrorInvalidValue; }
+
+    *pointer = static_cast<T*>(std::malloc(numBytes));
+    return *pointer || numBytes == 0 ? cudaSuccess : cudaErrorMemoryAllocation;
+}
+
+inline cudaError_t cudaFree(void* pointer)
+    { std::free(pointer); return cudaSuccess; }
+
+inline cudaError_t cudaMemcpy(void* dst, const void* src, size_t numBytes,
+    cudaMemcpyKind)
+{
+    if (numBytes > 0 && (!dst || !src)) { return cudaErrorInvalidValue; }
+
+    std::memcpy(dst, src, numBytes);
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemset(void* dst, int value, size_t numBytes) {
+    if (numBytes > 0 && !dst) { return cudaErrorInvalidValue; }
+
+    std::memset(dst, value, numBytes);
+    return cudaSuccess;
+}
+
+//----------------------------------------------------------------------------
+//
+//  class CudaCpuPool
+//
+//  A persistent pool of worker threads (one per core) that all run the
+//    same job for each launch, and then wait for the next one.
+//
+
+class CudaCpuPool {
+    std::vector<std::thread>  _workers;
+    std::function<void()>     _job;
+    size_t                    _generation = 0;
+    size_t                    _running = 0;
+    bool                      _stop = false;
+    std::mutex                _mutex;
+    std::condition_variable   _start;
+    std::condition_variable   _done;
+
+  public:
+    CudaCpuPool() {
+        size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (const char* value = std::getenv("CUDA_CPU_THREADS")) {
+            numThreads = std::max(1, std::atoi(value));
+        }
+
+        for (size_t i = 0; i < numThreads; ++i) {
+            _workers.emplace_back([this]() {
+                size_t generation = 0;
+
+                while (true) {
+                    std::unique_lock lock(_mutex);
+                    _start.wait(lock, [&]{ return _stop || _generation != generation; });
+                    if (_stop) { return; }
+
+                    generation = _generation;
+                    lock.unlock();
+
+                    _job();
+
+                    lock.lock();
+                    if (--_running == 0) { _done.notify_one(); }
+                }
+            });
+        }
+    }
+
+    ~CudaCpuPool() {
+        {
+            std::lock_guard lock(_mutex);
+            _stop = true;
+        }
+        _start.notify_all();
+        for (auto& worker : _workers) { worker.join(); }
+    }
+
+    // Run "job" on every worker, and wait for all of them to finish
+    void run(std::function<void()> job) {
+        std::unique_lock lock(_mutex);
+        _job = std::move(job);
+        _running = _workers.size();
+        ++_generation;
+        _start.notify_all();
+        _done.wait(lock, [&]{ return _running == 0; });
+    }
+
+    static CudaCpuPool& instance() {
+        static CudaCpuPool pool;
+        return pool;
+    }
+};
+
+//----------------------------------------------------------------------------
+//
+//  function cudaCpuLaunch()
+//
+//  Returns a callable that, when passed the kernel's arguments, executes
+//    the kernel for every thread of every block in the grid.  As with
+//    CUDA, the arguments are copied, and errors (an invalid configuration,
+//    or an exception thrown in a kernel) are reported through
+//    cudaGetLastError().
+//
+
+template <typename Kernel>
+class CudaCpuLauncher {
+    // Blocks are handed out to the workers in batches, to keep contention
+    //   on the shared counter low for grids with many small blocks
+    static constexpr size_t BlocksPerBatch = 16;
+
+    // CUDA's limit on the number of threads in a block
+    static constexpr size_t MaxThreadsPerBlock = 1024;
+
+    Kernel  _kernel;
+    dim3    _grid;
+    dim3    _block;
+
+  public:
+    CudaCpuLauncher(Kernel kernel, dim3 grid, dim3 block)
+        : _kernel(kernel), _grid(grid), _block(block) {}
+
+    template <typename... Args>
+    void operator () (Args&&... args) const {
+        if (_grid.count() == 0 || _block.count() == 0
+            || _block.count() > MaxThreadsPerBlock) {
+            cudaCpuLastError = cudaErrorInvalidConfiguration;
+            return;
+        }
+
+        std::tuple<std::decay_t<Args>...> arguments(std::forward<Args>(args)...);
+        std::atomic<size_t> nextBlock{0};
+        const size_t numBlocks = _grid.count();
+
+        CudaCpuPool::instance().run([&]() {
+            gridDim = _grid;
+            blockDim = _block;
+
+            try {
+                size_t first;
+                while ((first = nextBlock.fetch_add(BlocksPerBatch)) < numBlocks) {
+                    size_t last = std::min(numBlocks, first + BlocksPerBatch);
+
+                    for (size_t b = first; b < last; ++b) {
+                        blockIdx.x = b % _grid.x;
+                        blockIdx.y = (b / _grid.x) % _grid.y;
+                        blockIdx.z = b / (size_t(_grid.x) * _grid.y);
+
+                        for (threadIdx.z = 0; threadIdx.z < _block.z; ++threadIdx.z) {
+                        for (threadIdx.y = 0; threadIdx.y < _block.y; ++threadIdx.y) {
+                        for (threadIdx.x = 0; threadIdx.x < _block.x; ++threadIdx.x) {
+                            std::apply(_kernel, arguments);
+                        }}}
+                    }
+                }
+            }
+            catch (...) {
+                cudaCpuLastError = cudaErrorLaunchFailure;
+                nextBlock = numBlocks;
+            }
+        });
+    }
+};
+
+template <typename Kernel>
+CudaCpuLauncher<Kernel> cudaCpuLaunch(Kernel kernel, dim3 grid, dim3 block)
+    { return CudaCpuLauncher<Kernel>(kernel, grid, block); }
+
+#endif // __CUDACPU_H__
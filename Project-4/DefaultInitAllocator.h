@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  DefaultInitAllocator.h
+//
+//  An allocator for std::vector that default-initializes (rather than
+//    value-initializes) its elements.  For types like long or float, that
+//    means the elements are left uninitialized, so
+//
+//      std::vector<long, DefaultInitAllocator<long>> values(n);
+//
+//    doesn't write (and page-fault in) every byte of the vector before
+//    we've had a chance to fill it ourselves.  The pages are then
+//    physically allocated by whichever thread first touches them, which
+//    lets a parallel fill spread that work across all of the cores.
+//
+//  Large allocations are aligned to, and padded out to, a huge page, and
+//    the kernel is asked to back them with transparent huge pages, which
+//    reduces the number of page faults (and TLB misses) by a factor of 512.
+//
+
+#ifndef __DEFAULTINITALLOCATOR_H__
+#define __DEFAULTINITALLOCATOR_H__
+
+#include <sys/mman.h>
+
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+template <typename T>
+struct DefaultInitAllocator {
+    using value_type = T;
+
+    static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+    DefaultInitAllocator() = default;
+
+    template <typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t numBytes = n * sizeof(T);
+        void* memory = nullptr;
+
+        if (numBytes >= HugePageSize) {
+            numBytes = (numBytes + HugePageSize - 1) / HugePageSize * HugePageSize;
+            memory = std::aligned_alloc(HugePageSize, numBytes);
+#ifdef MADV_HUGEPAGE
+            if (memory) { madvise(memory, numBytes, MADV_HUGEPAGE); }
+#endif
+        }
+        else {
+            memory = std::malloc(numBytes);
+        }
+
+        if (!memory) { throw std::bad_alloc(); }
+
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* p, size_t)
+        { std::free(p); }
+
+    template <typename U>
+    void construct(U* p)
+        { ::new (static_cast<void*>(p)) U; }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+        { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template <typename U>
+    friend bool operator == (const DefaultInitAllocator&, const DefaultInitAllocator<U>&)
+        { return true; }
+
+    template <typename U>
+    friend bool operator != (const DefaultInitAllocator&, const DefaultInitAllocator<U>&)
+        { return false; }
+};
+
+#endif // __DEFAULTINITALLOCATOR_H__
@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  DoubleDouble.h
+//
+//  A small extended-precision floating-point type that represents a value
+//    as the unevaluated sum of two doubles (hi + lo, with |lo| <= ulp(hi)/2),
+//    giving about 106 bits (roughly 32 decimal digits) of precision.
+//
+//  The operations are the classic error-free transformations (Dekker,
+//    Knuth, and the QD library by Hida, Li, and Bailey).  Only the
+//    operations needed for computing a Mandelbrot reference orbit, and
+//    for reading coordinates from the command line, are provided.
+//
+
+#ifndef __DOUBLEDOUBLE_H__
+#define __DOUBLEDOUBLE_H__
+
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+struct DoubleDouble {
+    double hi = 0.0;
+    double lo = 0.0;
+
+    DoubleDouble() = default;
+    DoubleDouble(double hi, double lo = 0.0) : hi(hi), lo(lo) {}
+
+    explicit operator double() const { return hi + lo; }
+
+    //------------------------------------------------------------------------
+    //
+    //  Error-free transformations:  each returns the rounded result of the
+    //    operation, along with the exact rounding error
+    //
+
+    static DoubleDouble twoSum(double a, double b) {
+        double s = a + b;
+        double v = s - a;
+        return DoubleDouble(s, (a - (s - v)) + (b - v));
+    }
+
+    // Requires |a| >= |b|
+    static DoubleDouble quickTwoSum(double a, double b) {
+        double s = a + b;
+        return DoubleDouble(s, b - (s - a));
+    }
+
+    static DoubleDouble twoProd(double a, double b) {
+        double p = a * b;
+        return DoubleDouble(p, std::fma(a, b, -p));
+    }
+
+    //------------------------------------------------------------------------
+    //
+    //  Arithmetic
+    //
+
+    friend DoubleDouble operator - (const DoubleDouble& a)
+        { return DoubleDouble(-a.hi, -a.lo); }
+
+    friend DoubleDouble operator + (const DoubleDouble& a, const DoubleDouble& b) {
+        DoubleDouble s = twoSum(a.hi, b.hi);
+        DoubleDouble t = twoSum(a.lo, b.lo);
+        s.lo += t.hi;
+        s = quickTwoSum(s.hi, s.lo);
+        s.lo += t.lo;
+        return quickTwoSum(s.hi, s.lo);
+    }
+
+    friend DoubleDouble operator - (const DoubleDouble& a, const DoubleDouble& b)
+        { return a + -b; }
+
+    friend DoubleDouble operator * (const DoubleDouble& a, const DoubleDouble& b) {
+        DoubleDouble p = twoProd(a.hi, b.hi);
+        p.lo += a.hi * b.lo + a.lo * b.hi;
+        return quickTwoSum(p.hi, p.lo);
+    }
+
+    friend DoubleDouble operator / (const DoubleDouble& a, double b) {
+        double q1 = a.hi / b;
+        DoubleDouble r = a - twoProd(q1, b);
+        double q2 = r.hi / b;
+        r = r - twoProd(q2, b);
+        double q3 = r.hi / b;
+        DoubleDouble q = quickTwoSum(q1, q2);
+        return q + DoubleDouble(q3);
+    }
+
+    DoubleDouble& operator += (const DoubleDouble& a)
+        { return *this = *this + a; }
+
+    DoubleDouble& operator *= (const DoubleDouble& a)
+        { return *this = *this * a; }
+
+    //------------------------------------------------------------------------
+    //
+    //  parse() - convert a decimal string (e.g., "-0.7436438870371587"
+    //    or "1.5e-3") to a DoubleDouble without passing through a double,
+    //    which would discard all digits beyond the 17th.
+    //
+
+    static DoubleDouble parse(const std::string& text) {
+        size_t i = 0;
+        bool negative = false;
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            negative = text[i++] == '-';
+        }
+
+        DoubleDouble value;
+        int exponent = 0;
+        bool digits = false;
+        bool fraction = false;
+
+        for (; i < text.size(); ++i) {
+            char c = text[i];
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                value = value * DoubleDouble(10.0) + DoubleDouble(c - '0');
+                exponent -= fraction;
+                digits = true;
+            }
+            else if (c == '.' && !fraction) {
+                fraction = true;
+            }
+            else {
+                break;
+            }
+        }
+
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+            exponent += std::stoi(text.substr(i + 1));
+            i = text.size();
+        }
+
+        if (!digits || i != text.size()) {
+            throw std::invalid_argument("Unable to parse '" + text + "' as a number");
+        }
+
+        for (; exponent > 0; --exponent) { value *= DoubleDouble(10.0); }
+        for (; exponent < 0; ++exponent) { value = value / 10.0; }
+
+        return negative ? -value : value;
+    }
+};
+
+#endif // __DOUBLEDOUBLE_H__
@@ -1,9 +1,18 @@
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <numeric>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <unistd.h>
+
+#include "DefaultInitAllocator.h"
+
 using Count = size_t;
 using DataType = long;
 
@@ -11,22 +20,133 @@ const DataType DefalutStartValue = -6.0;
 const Count TestSize = 1'000'000'000;
 const Count NumCheckValues = 500;
 
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+//----------------------------------------------------------------------------
+//
+//  function parallelIota()
+//
+//  The parallel version:  the vector's memory is allocated, but not
+//    initialized (see DefaultInitAllocator.h), and each thread fills (and
+//    so first-touches, and has the kernel allocate the pages for) its own
+//    disjoint range of the vector.  Every value is then verified, again
+//    in parallel, rather than a sample of them.
+//
+//  Returns the time taken to allocate and fill the vector.
+//
+
+Seconds parallelIota(Count numValues, DataType startValue, size_t numThreads) {
+    auto start = Clock::now();
+
+    std::vector<DataType, DefaultInitAllocator<DataType>> values(numValues);
+
+    auto forEachRange = [&](auto&& kernel) {
+        std::vector<std::thread> threads(numThreads);
+        Count chunkSize = (numValues + numThreads - 1) / numThreads;
+
+        for (size_t id = 0; id < numThreads; ++id) {
+            Count begin = std::min(numValues, id * chunkSize);
+            Count end = std::min(numValues, begin + chunkSize);
+            threads[id] = std::thread(kernel, begin, end);
+        }
+
+        for (auto& thread : threads) { thread.join(); }
+    };
+
+    forEachRange([&](Count begin, Count end) {
+        std::iota(values.data() + begin, values.data() + end,
+            startValue + static_cast<DataType>(begin));
+    });
+
+    Seconds fillTime = Clock::now() - start;
+
+    std::atomic<Count> mismatch{numValues};
+    forEachRange([&](Count begin, Count end) {
+        for (Count i = begin; i < end; ++i) {
+            if (values[i] != startValue + static_cast<DataType>(i)) {
+                mismatch = i;
+                break;
+            }
+        }
+    });
+
+    if (mismatch != numValues) {
+        Count i = mismatch;
+        std::cerr << "Values do not match for position " << i
+            << values[i] << " != " << startValue + static_cast<DataType>(i)
+            << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    return fillTime;
+}
+
 int main(int argc, char* argv[]) {
-    Count numValues = argc > 1 ? std::stol(argv[1]) : TestSize;
+    bool parallel = false;
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    int option;
+    const char* options = "hpt:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[hpt] [count]\n"
+                    "    -h           show help message\n"
+                    "    -p           fill uninitialized memory in parallel\n"
+                    "    -t <value>   use <value> threads with -p (default: %zu)\n"
+                    "\n"
+                    "  The fill's bandwidth (in GB/s) is written to stdout\n";
 
-    std::vector<DataType> values(numValues);
+                    fprintf(stderr, help, argv[0], numThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'p':
+                parallel = true;
+                break;
+
+            case 't': {
+                long value = std::stol(optarg);
+                if (value < 1) {
+                    std::cerr << "The number of threads must be at least 1\n";
+                    exit(EXIT_FAILURE);
+                }
+                numThreads = value;
+            } break;
+        }
+    }
 
+    Count numValues = optind < argc ? std::stol(argv[optind]) : TestSize;
     DataType startValue = DefalutStartValue;
-    std::iota(std::begin(values), std::end(values), startValue);
 
-    Count step = numValues / NumCheckValues;
-    for (int i = 6, n = 0; i < numValues && n < NumCheckValues; ++n, i += step) {
-        DataType checkValue = startValue + static_cast<DataType>(i);
+    Seconds fillTime;
 
-        if (values[i] != checkValue) {
-            std::cerr << "Values do not match for position " << i
-                << values[i] << " != " << checkValue << "\n";
-            exit(EXIT_FAILURE);
+    if (parallel) {
+        fillTime = parallelIota(numValues, startValue, numThreads);
+    }
+    else {
+        auto start = Clock::now();
+
+        std::vector<DataType> values(numValues);
+
+        std::iota(std::begin(values), std::end(values), startValue);
+
+        fillTime = Clock::now() - start;
+
+        Count step = numValues / NumCheckValues;
+        for (Count i = 6, n = 0; i < numValues && n < NumCheckValues; ++n, i += step) {
+            DataType checkValue = startValue + static_cast<DataType>(i);
+
+            if (values[i] != checkValue) {
+                std::cerr << "Values do not match for position " << i
+                    << values[i] << " != " << checkValue << "\n";
+                exit(EXIT_FAILURE);
+            }
         }
     }
+
+    double numBytes = numValues * sizeof(DataType);
+    printf("%.2f GB/s\n", numBytes / fillTime.count() / 1.0e9);
 }
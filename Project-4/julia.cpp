@@ -1,6 +1,22 @@
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <complex>
+#include <condition_variable>
+#include <cstdio>
 #include <fstream>
+#include <memory>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "DoubleDouble.h"
 
 //----------------------------------------------------------------------------
 //
@@ -25,17 +41,21 @@ struct Color {
     Color(T r, T g, T b) : r(r), g(g), b(b) {}
 };
 
+using Image = std::vector<Color>;
+using Iterations = std::vector<int>;
+
 //----------------------------------------------------------------------------
 //
 //  function setColor()
 //
-//  This function returns a color based on an iteration value.
+//  This function returns a color based on an iteration value (pixels that
+//    reached "maxIterations" are in the set, and colored black).
 //
 //  As this function is called from an executing GPU kernel (julia), it's
 //    tagged as being a device-only function (using the __device__ decoration)
 //
 
-Color setColor(int iterations) {
+Color setColor(int iterations, size_t maxIterations = MaxIterations) {
     constexpr size_t NumColors = 16;
     const Color colors[NumColors] = {
         Color(66, 30, 15),
@@ -58,52 +78,541 @@ Color setColor(int iterations) {
 
     const Color black;
 
-    return iterations < MaxIterations ? colors[iterations % NumColors] : black;
+    return size_t(iterations) < maxIterations ? colors[iterations % NumColors] : black;
 }
 
+inline float magnitude(const Complex& z) { return std::abs(z); }
+
 //----------------------------------------------------------------------------
 //
-//  function main()
+//  function escapeTime()
 //
-//  Nothing particularly special here.  We specify the region in the Complex
-//    plane we're interested in looking at using its lower-left, and upper-
-//    right corners (the variables "ll", and "ur", respectively).
+//  The per-pixel kernel:  iterate z = z*z + c until z escapes (its
+//    magnitude exceeds 2), or we run out of iterations.
+//
+
+int escapeTime(const Complex& c, size_t maxIterations) {
+    Complex z;
+
+    size_t iter = 0;
+    while (iter < maxIterations && magnitude(z) < 2.0) {
+        z = z*z + c;
+        ++iter;
+    }
+
+    return iter;
+}
+
+//----------------------------------------------------------------------------
+//
+//  struct View
 //
-//  From there, we determine the size of the region, its center point, and
-//    the size of a pixel in the complex plane.
+//  A view of the complex plane for one frame of an animation, described by
+//    the complex coordinate at the image's center, and the (square) size of
+//    a pixel.  Pixel (x, y) maps to the coordinate
 //
-//  Once the computation is done, we output the results in an image named 
-//    "julia.ppm".
+//      center + ((x - Width/2) * pixelSize, (y - Height/2) * pixelSize)
+//
+//  The center is kept in double-double precision, as for deep zooms its
+//    digits beyond the 17th are what select the region of interest.  The
+//    offset of a pixel from the center is always representable in a double.
 //
 
-inline float magnitude(const Complex& z) { return std::abs(z); }
+struct View {
+    DoubleDouble x;
+    DoubleDouble y;
+    double pixelSize;
+
+    std::complex<double> offset(size_t px, size_t py) const {
+        return std::complex<double>((double(px) - 0.5 * Width) * pixelSize,
+                                    (double(py) - 0.5 * Height) * pixelSize);
+    }
+
+    Complex operator () (size_t px, size_t py) const {
+        auto d = offset(px, py);
+        return Complex(double(x) + d.real(), double(y) + d.imag());
+    }
+};
+
+//----------------------------------------------------------------------------
+//
+//  struct Reference
+//
+//  Single-precision iteration falls apart once a pixel is smaller than
+//    about 1e-6, as neighboring pixels round to the same coordinate.  For
+//    deep zooms we use perturbation theory instead:  one reference orbit
+//    Z_n is iterated in double-double precision at the view's center C,
+//    and every pixel at C + dc is iterated as a (double-precision) delta
+//    against it, z_n = Z_n + dz_n, where
+//
+//      dz_{n+1} = 2 Z_n dz_n + dz_n^2 + dc
+//
+//    Only dz needs to resolve the pixel spacing, and it stays small and
+//    well-scaled, so doubles suffice down to widths of about 1e-30.
+//
+//  A pixel's delta becomes inaccurate (a "glitch") when z_n passes close
+//    to zero while Z_n doesn't, so dz_n is no longer small relative to z_n
+//    (detected with Pauldelbrot's criterion |z_n| < GlitchTolerance |Z_n|),
+//    or when the reference orbit escapes before the pixel's orbit does.
+//    Either way the pixel is rebased:  its current value becomes the delta
+//    against the start of the reference orbit (dz = z_n, n = 0), which is
+//    always valid as Z_0 = 0 and Z_1 = C.
+//
+
+struct Reference {
+    static constexpr double GlitchTolerance = 1.0e-3;
+
+    std::vector<std::complex<double>> orbit;
+
+    Reference(const View& view, size_t maxIterations) {
+        DoubleDouble x;
+        DoubleDouble y;
+
+        orbit.reserve(maxIterations + 1);
+        orbit.emplace_back(0.0, 0.0);
+
+        for (size_t n = 0; n < maxIterations; ++n) {
+            DoubleDouble xx = x * x;
+            DoubleDouble yy = y * y;
+            DoubleDouble xy = x * y;
+
+            x = xx - yy + view.x;
+            y = xy + xy + view.y;
+
+            orbit.emplace_back(double(x), double(y));
+            if (std::norm(orbit.back()) > 4.0) { break; }
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+//
+//  function perturbedEscapeTime()
+//
+//  The deep-zoom equivalent of escapeTime(), iterating the pixel at offset
+//    "dc" from the reference orbit's center.  "rebases" is incremented for
+//    each glitch corrected.
+//
+
+int perturbedEscapeTime(const Reference& reference, std::complex<double> dc,
+    size_t maxIterations, size_t& rebases)
+{
+    using Delta = std::complex<double>;
+
+    const auto& Z = reference.orbit;
+    const size_t last = Z.size() - 1;
+    const double tolerance = Reference::GlitchTolerance
+        * Reference::GlitchTolerance;
+
+    Delta dz;
+    Delta z;
+    size_t n = 0;
+
+    size_t iter = 0;
+    while (iter < maxIterations && std::norm(z) < 4.0) {
+        dz = (2.0 * Z[n] + dz) * dz + dc;
+        ++n;
+        ++iter;
+
+        z = Z[n] + dz;
+
+        double zz = std::norm(z);
+        if (n == last || zz < std::norm(dz) || zz < tolerance * std::norm(Z[n])) {
+            dz = z;
+            n = 0;
+            ++rebases;
+        }
+    }
+
+    return iter;
+}
 
-int main() {
-    Complex ll(-2.1, -2.1);
-    Complex ur( 2.1,  2.1);
-    Complex domain = ur - ll;
-    Complex center = 0.5 * domain;
-    Complex d(domain.real()/Width, domain.imag()/Height);
-
-    Color pixels[Height * Width];
-
-    for (auto y = 0; y < Height; ++y) {
-        for (auto x = 0; x < Width; ++x) {
-            Complex c(x*d.real(), y*d.imag());
-            c -= center;
-            Complex z;
-            
-            int iter = 0;
-            while (iter < MaxIterations && magnitude(z) < 2.0) {
-                z = z*z + c;
-                ++iter;
+//----------------------------------------------------------------------------
+//
+//  struct Settings
+//
+//  The rendering options given on the command line:  the iteration limit,
+//    the number of threads, and whether to use perturbation.  A single
+//    thread (the default) keeps julia.cpu the serial baseline that the GPU
+//    version is compared with.
+//
+
+struct Settings {
+    size_t maxIterations = MaxIterations;
+    size_t numThreads = 1;
+    bool   deep = false;
+};
+
+//----------------------------------------------------------------------------
+//
+//  function render()
+//
+//  Computes the iteration counts for every pixel in "view", using
+//    "settings.numThreads" threads (rows are handed out to the threads one
+//    at a time).  When "settings.deep" is set, the pixels are computed
+//    using perturbation (see struct Reference), and "rebases" is set to the
+//    number of glitches corrected.
+//
+//  If the previous frame's view and iteration counts are provided, any pixel
+//    that lands exactly on a pixel of the previous frame (which happens,
+//    for example, for every other row and column when zooming by a factor
+//    of two around a fixed center) reuses that pixel's iteration count
+//    instead of recomputing it.  As the previous frame itself reused
+//    values from the frame before it, a coordinate is only ever computed
+//    once over the entire animation.
+//
+//  The function returns the number of reused pixels.
+//
+
+size_t render(const View& view, Iterations& iterations, const Settings& settings,
+    size_t& rebases, const View* previousView = nullptr,
+    const Iterations* previous = nullptr)
+{
+    // Tolerance (in units of the previous frame's pixels) for deciding that
+    //   a pixel coincides with a pixel in the previous frame
+    constexpr double Epsilon = 1.0e-6;
+
+    // For each row (and column), the index of the matching row (and
+    //   column) in the previous frame, or -1 if there isn't one.  Since
+    //   the views are axis-aligned, a pixel can be reused exactly when both
+    //   its row and its column have a match.
+    auto match = [&](size_t count, double shift) {
+        std::vector<long> indices(count, -1);
+        if (!previous) { return indices; }
+
+        double scale = view.pixelSize / previousView->pixelSize;
+        double offset = shift / previousView->pixelSize;
+
+        for (size_t i = 0; i < count; ++i) {
+            double u = (double(i) - 0.5 * count) * scale + 0.5 * count + offset;
+            double n = std::round(u);
+            if (std::abs(u - n) < Epsilon && n >= 0.0 && n < count) {
+                indices[i] = long(n);
             }
-            
-            pixels[x + y * Width] = setColor(iter);
         }
+
+        return indices;
+    };
+
+    auto columns = match(Width,
+        previous ? double(view.x - previousView->x) : 0.0);
+    auto rows = match(Height,
+        previous ? double(view.y - previousView->y) : 0.0);
+
+    const bool deep = settings.deep;
+    const size_t maxIterations = settings.maxIterations;
+
+    std::unique_ptr<Reference> reference;
+    if (deep) { reference = std::make_unique<Reference>(view, maxIterations); }
+
+    std::atomic<size_t> nextRow{0};
+    std::atomic<size_t> reused{0};
+    std::atomic<size_t> glitches{0};
+
+    auto worker = [&]() {
+        size_t localReused = 0;
+        size_t localRebases = 0;
+
+        for (size_t y; (y = nextRow++) < Height; ) {
+            for (size_t x = 0; x < Width; ++x) {
+                int& iter = iterations[x + y * Width];
+
+                if (rows[y] >= 0 && columns[x] >= 0) {
+                    iter = (*previous)[columns[x] + rows[y] * Width];
+                    ++localReused;
+                }
+                else if (deep) {
+                    iter = perturbedEscapeTime(*reference, view.offset(x, y),
+                        maxIterations, localRebases);
+                }
+                else {
+                    iter = escapeTime(view(x, y), maxIterations);
+                }
+            }
+        }
+
+        reused += localReused;
+        glitches += localRebases;
+    };
+
+    if (settings.numThreads <= 1) {
+        worker();
+    }
+    else {
+        std::vector<std::thread> threads(settings.numThreads);
+        for (auto& thread : threads) { thread = std::thread(worker); }
+        for (auto& thread : threads) { thread.join(); }
     }
 
-    std::ofstream ppm("julia.ppm", std::ios::binary);
+    rebases = glitches;
+
+    return reused;
+}
+
+//----------------------------------------------------------------------------
+//
+//  function writeImage()
+//
+//  Output an image in the binary PPM format
+//
+
+void writeImage(const std::string& filename, const Image& pixels) {
+    std::ofstream ppm(filename, std::ios::binary);
     ppm << "P6 " << Width << " " << Height << " " << 255 << "\n";
-    ppm.write(reinterpret_cast<const char*>(&pixels[0]), sizeof(pixels));
+    ppm.write(reinterpret_cast<const char*>(pixels.data()),
+        pixels.size() * sizeof(Color));
+}
+
+//----------------------------------------------------------------------------
+//
+//  class FrameQueue
+//
+//  A small bounded queue used to pipeline an animation:  the main thread
+//    computes frames and pushes their images, while a writer thread pops
+//    images, and encodes and writes them to disk.  The bound keeps the
+//    compute thread from racing arbitrarily far ahead (and using an
+//    unbounded amount of memory) when the disk is the bottleneck.
+//
+
+class FrameQueue {
+    struct Frame {
+        size_t index;
+        Image  pixels;
+    };
+
+    size_t                   _capacity;
+    bool                     _done = false;
+    std::queue<Frame>        _frames;
+    std::mutex               _mutex;
+    std::condition_variable  _ready;
+    std::condition_variable  _space;
+
+  public:
+    FrameQueue(size_t capacity) : _capacity(capacity) {}
+
+    void push(size_t index, Image&& pixels) {
+        std::unique_lock lock(_mutex);
+        _space.wait(lock, [&]{ return _frames.size() < _capacity; });
+        _frames.push(Frame{index, std::move(pixels)});
+        _ready.notify_one();
+    }
+
+    // Returns false once the queue has been closed, and drained
+    bool pop(size_t& index, Image& pixels) {
+        std::unique_lock lock(_mutex);
+        _ready.wait(lock, [&]{ return _done || !_frames.empty(); });
+        if (_frames.empty()) { return false; }
+
+        index = _frames.front().index;
+        pixels = std::move(_frames.front().pixels);
+        _frames.pop();
+        _space.notify_one();
+
+        return true;
+    }
+
+    void close() {
+        std::lock_guard lock(_mutex);
+        _done = true;
+        _ready.notify_all();
+    }
+};
+
+//----------------------------------------------------------------------------
+//
+//  function animate()
+//
+//  Render a zoom animation of "numFrames" frames into the center of the
+//    "start" view, magnifying by "zoom" each frame, in a single process.
+//    Images are written as "<prefix>-NNNN.ppm" by a separate writer
+//    thread, so that frame k is being encoded and written while frame k+1
+//    is being computed.
+//
+
+void animate(size_t numFrames, double zoom, const View& start,
+    const Settings& settings, const std::string& prefix)
+{
+    using Clock = std::chrono::steady_clock;
+
+    FrameQueue queue(2);
+
+    std::thread writer([&]() {
+        size_t index;
+        Image pixels;
+        while (queue.pop(index, pixels)) {
+            char filename[256];
+            snprintf(filename, sizeof(filename), "%s-%04zu.ppm",
+                prefix.c_str(), index);
+            writeImage(filename, pixels);
+        }
+    });
+
+    auto startTime = Clock::now();
+
+    View view = start;
+    View previousView;
+    Iterations iterations(Width * Height);
+    Iterations previous(Width * Height);
+    size_t reused = 0;
+    size_t rebases = 0;
+
+    for (size_t frame = 0; frame < numFrames; ++frame) {
+        size_t frameRebases;
+        reused += frame == 0 ? render(view, iterations, settings, frameRebases)
+            : render(view, iterations, settings, frameRebases, &previousView,
+                &previous);
+        rebases += frameRebases;
+
+        Image pixels(Width * Height);
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            pixels[i] = setColor(iterations[i], settings.maxIterations);
+        }
+        queue.push(frame, std::move(pixels));
+
+        std::swap(iterations, previous);
+        previousView = view;
+        view.pixelSize /= zoom;
+    }
+
+    queue.close();
+    writer.join();
+
+    std::chrono::duration<double> seconds = Clock::now() - startTime;
+    size_t numPixels = numFrames * Width * Height;
+
+    std::cout << "Frames = " << numFrames << "\n"
+        << "Time = " << seconds.count() << " s\n"
+        << "Frames/sec = " << numFrames / seconds.count() << "\n"
+        << "Reused pixels = " << 100.0 * reused / numPixels << "%\n";
+
+    if (settings.deep) { std::cout << "Rebases = " << rebases << "\n"; }
+}
+
+//----------------------------------------------------------------------------
+//
+//  function main()
+//
+//  Nothing particularly special here.  We specify the region in the Complex
+//    plane we're interested in looking at using its center, and its width
+//    (by default, the square from (-2.1, -2.1) to (2.1, 2.1)), from which
+//    we determine the size of a pixel in the complex plane.
+//
+//  By default, a single image named "julia.ppm" is computed.  When a number
+//    of frames is given (-n), an animation zooming into the center is
+//    rendered instead (see animate()).  Single precision is only good to
+//    widths of about 1e-5; for anything deeper, use perturbation (-d),
+//    along with a center given to as many digits as the zoom requires,
+//    and (usually) more iterations.
+//
+
+int main(int argc, char* argv[]) {
+    size_t numFrames = 0;
+    double zoom = 2.0;
+    double width = 4.2;
+    Settings settings;
+    std::string centerX;
+    std::string centerY;
+    std::string prefix = "julia";
+
+    // The default center for animations and deep zooms ("Seahorse Valley")
+    const char* targetX = "-0.743643887037158704752191506114774";
+    const char* targetY = "0.131825904205311970493132056385139";
+
+    int option;
+    const char* options = "dhm:n:o:t:w:x:y:z:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[dhmnotwxyz]\n"
+                    "    -h           show help message\n"
+                    "    -d           deep zoom using perturbation\n"
+                    "    -m <value>   maximum iterations per pixel (default: %zu)\n"
+                    "    -n <value>   render an animation of <value> frames\n"
+                    "    -o <name>    animation frames are named <name>-NNNN.ppm (default: %s)\n"
+                    "    -t <value>   render using <value> threads (default: %zu)\n"
+                    "    -w <value>   width of the (first) image in the complex plane (default: %g)\n"
+                    "    -x <value>   real part of the image's center\n"
+                    "    -y <value>   imaginary part of the image's center\n"
+                    "    -z <value>   magnification per frame (default: %g)\n"
+                    "\n"
+                    "  The center defaults to (0, 0) for a single image, and to\n"
+                    "    (%s, %s)\n"
+                    "    for animations and deep zooms\n";
+
+                    fprintf(stderr, help, argv[0], settings.maxIterations,
+                        prefix.c_str(), settings.numThreads, width, zoom, targetX, targetY);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 'd':
+                settings.deep = true;
+                break;
+
+            case 'm':
+                settings.maxIterations = std::stol(optarg);
+                break;
+
+            case 'n':
+                numFrames = std::stol(optarg);
+                break;
+
+            case 'o':
+                prefix = optarg;
+                break;
+
+            case 't':
+                settings.numThreads = std::max(1l, std::stol(optarg));
+                break;
+
+            case 'w':
+                width = std::stod(optarg);
+                break;
+
+            case 'x':
+                centerX = optarg;
+                break;
+
+            case 'y':
+                centerY = optarg;
+                break;
+
+            case 'z':
+                zoom = std::stod(optarg);
+                break;
+        }
+    }
+
+    bool zooming = settings.deep || numFrames > 0;
+    if (centerX.empty()) { centerX = zooming ? targetX : "0"; }
+    if (centerY.empty()) { centerY = zooming ? targetY : "0"; }
+
+    View view{DoubleDouble::parse(centerX), DoubleDouble::parse(centerY),
+        width / Width};
+
+    if (numFrames > 0) {
+        animate(numFrames, zoom, view, settings, prefix);
+        return EXIT_SUCCESS;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    size_t rebases;
+    Iterations iterations(Width * Height);
+    render(view, iterations, settings, rebases);
+
+    std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - startTime;
+
+    Image pixels(Width * Height);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = setColor(iterations[i], settings.maxIterations);
+    }
+
+    writeImage("julia.ppm", pixels);
+
+    if (settings.deep) {
+        std::cout << "Time = " << seconds.count() << " s\n"
+            << "Rebases = " << rebases << "\n";
+    }
 }
@@ -1,19 +1,25 @@
 #! /usr/bin/env bash
 
 if [ "$#" -lt 1 ] ; then
-    echo "Usage: $0 <program>"
+    echo "Usage: $0 <program> [options]"
+    echo "    e.g., $0 ./iota.cpu -p -t 16"
     exit
 else
-    cmd=$1
+    cmd=$@
 fi
 
-echo "|Vector<br>Length|Wall Clock<br>Time|User Time|System Time|"
-echo "|:--:|--:|--:|--:|"
+echo "|Vector<br>Length|Wall Clock<br>Time|User Time|System Time|Bandwidth<br>(GB/s)|"
+echo "|:--:|--:|--:|--:|--:|"
 
 format="%e %U %S"
 
 vectorSizes=(10 100 1000 10000 100000 1000000 5000000 100000000 500000000 1000000000 5000000000)
 for size in ${vectorSizes[@]} ; do
-    runTime=( $( /usr/bin/time -f"$format" $cmd $size 2>&1 ; ) )
-    printf "|%d|%5.2f|%5.2f|%5.2f|\n" $size ${runTime[@]}
-done
\ No newline at end of file
+    # Programs that report their bandwidth (as "<value> GB/s") on stdout
+    #   produce two extra fields ahead of the timing values
+    output=( $( /usr/bin/time -f"$format" $cmd $size 2>&1 ; ) )
+    count=${#output[@]}
+    runTime=( ${output[@]:count-3} )
+    bandwidth=$( [ $count -ge 5 ] && echo ${output[0]} || echo "-" )
+    printf "|%d|%5.2f|%5.2f|%5.2f|%s|\n" $size ${runTime[@]} $bandwidth
+done
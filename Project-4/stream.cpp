@@ -0,0 +1,335 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  stream.cpp - A STREAM-style memory bandwidth benchmark
+//
+//  Measures the sustained bandwidth of the four STREAM kernels (after John
+//    McCalpin's benchmark), plus a read-only reduction:
+//
+//      copy:    c[i] = a[i]                  (2 words moved per element)
+//      scale:   b[i] = s * c[i]              (2 words)
+//      add:     c[i] = a[i] + b[i]           (3 words)
+//      triad:   a[i] = b[i] + s * c[i]       (3 words)
+//      reduce:  sum += a[i]                  (1 word)
+//
+//  for the same vector lengths used by runTrials.sh, and across a range of
+//    thread counts.  Each measurement is labeled with the level of the
+//    memory hierarchy its working set (the arrays its kernel touches) fits
+//    in:  the private caches (L1 and L2) are sized per thread, while the
+//    last-level cache (LLC) is shared by all of them.  The row's level is
+//    that of the three-array kernels;  a kernel touching fewer arrays
+//    whose level differs has its own level shown after its bandwidth.
+//    Vector lengths whose arrays don't fit in (half of) physical memory
+//    are skipped.
+//
+//  Results are printed as a markdown table, in the format of runTrials.sh,
+//    followed by a summary of the best bandwidth seen at each level.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "DefaultInitAllocator.h"
+
+using Count = size_t;
+using DataType = double;
+using Vector = std::vector<DataType, DefaultInitAllocator<DataType>>;
+
+// Each measurement repeats its kernel until at least this many bytes have
+//   been moved (so small vectors run long enough to be timed), and the
+//   best of NumTrials measurements is reported
+const double TargetBytes = 1.0e9;
+const size_t NumTrials = 3;
+
+const DataType Scalar = 3.0;
+
+//----------------------------------------------------------------------------
+//
+//  Kernels
+//
+
+enum Kernel { Copy, Scale, Add, Triad, Reduce, NumKernels };
+
+// Words moved per element, which is also the number of arrays touched
+const size_t WordsMoved[NumKernels] = { 2, 2, 3, 3, 1 };
+
+// Independent partial sums in the reduction, so its additions don't each
+//   wait on the previous one (and can vectorize)
+const size_t NumPartialSums = 8;
+
+struct Arrays {
+    Vector a;
+    Vector b;
+    Vector c;
+
+    Arrays(Count n) : a(n), b(n), c(n) {}
+};
+
+// Run "kernel" over elements [begin, end), "reps" times.  Returns the
+//   reduction's sum (and zero for the other kernels) so it can't be
+//   optimized away
+DataType run(Kernel kernel, Arrays& v, Count begin, Count end, size_t reps) {
+    DataType* a = v.a.data();
+    DataType* b = v.b.data();
+    DataType* c = v.c.data();
+    DataType sum = 0.0;
+
+    for (size_t rep = 0; rep < reps; ++rep) {
+        switch (kernel) {
+            case Copy:
+                for (Count i = begin; i < end; ++i) { c[i] = a[i]; }
+                break;
+
+            case Scale:
+                for (Count i = begin; i < end; ++i) { b[i] = Scalar * c[i]; }
+                break;
+
+            case Add:
+                for (Count i = begin; i < end; ++i) { c[i] = a[i] + b[i]; }
+                break;
+
+            case Triad:
+                for (Count i = begin; i < end; ++i) { a[i] = b[i] + Scalar * c[i]; }
+                break;
+
+            case Reduce: {
+                DataType partial[NumPartialSums] = {};
+
+                Count i = begin;
+                for (; i + NumPartialSums <= end; i += NumPartialSums) {
+                    for (size_t j = 0; j < NumPartialSums; ++j) { partial[j] += a[i + j]; }
+                }
+                for (; i < end; ++i) { partial[0] += a[i]; }
+
+                for (auto p : partial) { sum += p; }
+            } break;
+
+            default:
+                break;
+        }
+    }
+
+    return sum;
+}
+
+//----------------------------------------------------------------------------
+//
+//  function forEachRange()
+//
+//  Split [0, n) into one contiguous range per thread, and run "work" on
+//    each range in its own thread.  The threads wait until they've all
+//    been created before starting, and the returned time covers from
+//    their release until the last of them finishes.
+//
+
+template <typename Work>
+double forEachRange(Count n, size_t numThreads, Work&& work) {
+    std::vector<std::thread> threads(numThreads);
+    std::atomic<bool> go{false};
+    Count chunkSize = (n + numThreads - 1) / numThreads;
+
+    for (size_t id = 0; id < numThreads; ++id) {
+        Count begin = std::min(n, id * chunkSize);
+        Count end = std::min(n, begin + chunkSize);
+
+        threads[id] = std::thread([&, id, begin, end]() {
+            while (!go.load(std::memory_order_acquire)) { /* spin */ }
+            work(id, begin, end);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) { thread.join(); }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    return seconds.count();
+}
+
+//----------------------------------------------------------------------------
+//
+//  Cache hierarchy
+//
+
+struct Caches {
+    size_t l1;
+    size_t l2;
+    size_t llc;
+
+    Caches() {
+        auto size = [](int name, size_t fallback) {
+            long value = sysconf(name);
+            return value > 0 ? size_t(value) : fallback;
+        };
+
+        l1 = size(_SC_LEVEL1_DCACHE_SIZE, 32 * 1024);
+        l2 = size(_SC_LEVEL2_CACHE_SIZE, 1024 * 1024);
+        llc = size(_SC_LEVEL3_CACHE_SIZE, 0);
+        if (llc == 0) { llc = std::max(l2, size_t(32 * 1024 * 1024)); }
+    }
+
+    std::string level(size_t workingSet, size_t numThreads) const {
+        size_t perThread = workingSet / numThreads;
+
+        return perThread <= l1 ? "L1"
+            : perThread <= l2 ? "L2"
+            : workingSet <= llc ? "LLC"
+            : "DRAM";
+    }
+};
+
+//----------------------------------------------------------------------------
+//
+//  function main()
+//
+
+int main(int argc, char* argv[]) {
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    int option;
+    const char* options = "ht:";
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'h': {
+                const char* help =
+                    "Usage: %s -[ht] [lengths ...]\n"
+                    "    -h           show help message\n"
+                    "    -t <value>   sweep from 1 to <value> threads (default: %zu)\n"
+                    "\n"
+                    "  Vector lengths default to those used by runTrials.sh\n";
+
+                    fprintf(stderr, help, argv[0], maxThreads);
+                    exit(EXIT_SUCCESS);
+            } break;
+
+            case 't': {
+                long value = std::stol(optarg);
+                if (value < 1) {
+                    std::cerr << "The number of threads must be at least 1\n";
+                    exit(EXIT_FAILURE);
+                }
+                maxThreads = value;
+            } break;
+        }
+    }
+
+    std::vector<Count> vectorSizes = { 10, 100, 1000, 10000, 100000, 1000000,
+        5000000, 100000000, 500000000, 1000000000, 5000000000 };
+    if (optind < argc) {
+        vectorSizes.clear();
+        for (int i = optind; i < argc; ++i) { vectorSizes.push_back(std::stol(argv[i])); }
+    }
+
+    // Thread counts: powers of two up to, and including, maxThreads
+    std::vector<size_t> threadCounts;
+    for (size_t t = 1; t < maxThreads; t *= 2) { threadCounts.push_back(t); }
+    threadCounts.push_back(maxThreads);
+
+    const Caches caches;
+    const double physicalMemory = double(sysconf(_SC_PHYS_PAGES))
+        * sysconf(_SC_PAGESIZE);
+
+    // Best bandwidth (in GB/s) seen for each level, and kernel
+    std::map<std::string, std::vector<double>> best;
+
+    printf("|Vector<br>Length|Threads|Level|Copy<br>(GB/s)|Scale<br>(GB/s)"
+        "|Add<br>(GB/s)|Triad<br>(GB/s)|Reduce<br>(GB/s)|\n");
+    printf("|:--:|:--:|:--:|--:|--:|--:|--:|--:|\n");
+
+    for (auto size : vectorSizes) {
+        double workingSet = 3.0 * size * sizeof(DataType);
+        if (workingSet > 0.5 * physicalMemory) {
+            fprintf(stderr, "Skipping vector length %zu (%.1f GB of arrays)\n",
+                size, workingSet / 1.0e9);
+            continue;
+        }
+
+        Arrays arrays(size);
+
+        for (auto numThreads : threadCounts) {
+            // (Re-)initialize the arrays from the threads that will use
+            //   them, so each range's pages are local to its thread
+            forEachRange(size, numThreads, [&](size_t, Count begin, Count end) {
+                std::fill(arrays.a.data() + begin, arrays.a.data() + end, 1.0);
+                std::fill(arrays.b.data() + begin, arrays.b.data() + end, 2.0);
+                std::fill(arrays.c.data() + begin, arrays.c.data() + end, 0.0);
+            });
+
+            std::string rowLevel = caches.level(workingSet, numThreads);
+
+            printf("|%zu|%zu|%s|", size, numThreads, rowLevel.c_str());
+
+            for (int k = 0; k < NumKernels; ++k) {
+                Kernel kernel = Kernel(k);
+                double bytes = double(WordsMoved[k]) * sizeof(DataType) * size;
+
+                std::string level = caches.level(bytes, numThreads);
+                auto& levelBest = best[level];
+                levelBest.resize(NumKernels);
+                size_t reps = std::max(size_t(1), size_t(TargetBytes / bytes));
+
+                std::vector<DataType> sums(numThreads);
+                double seconds = 1.0e30;
+
+                for (size_t trial = 0; trial < NumTrials; ++trial) {
+                    seconds = std::min(seconds, forEachRange(size, numThreads,
+                        [&](size_t id, Count begin, Count end) {
+                            sums[id] = run(kernel, arrays, begin, end, reps);
+                        }));
+                }
+
+                double bandwidth = bytes * reps / seconds / 1.0e9;
+                levelBest[k] = std::max(levelBest[k], bandwidth);
+
+                if (level == rowLevel) { printf("%.2f|", bandwidth); }
+                else { printf("%.2f (%s)|", bandwidth, level.c_str()); }
+
+                // Check the reduction against a serial sum of a[], which the
+                //   other kernels have left filled with 15's
+                if (kernel == Reduce) {
+                    DataType total = 0.0;
+                    for (auto sum : sums) { total += sum; }
+
+                    DataType expected = 0.0;
+                    for (Count i = 0; i < size; ++i) { expected += arrays.a[i]; }
+                    expected *= reps;
+
+                    if (std::abs(total - expected) > 1.0e-9 * std::abs(expected)) {
+                        fprintf(stderr, "Reduce sum %g doesn't match %g (length %zu)\n",
+                            total, expected, size);
+                    }
+                }
+            }
+
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    printf("\nBest bandwidth per level (L1: %zu KB, L2: %zu KB, LLC: %zu KB)\n\n",
+        caches.l1 / 1024, caches.l2 / 1024, caches.llc / 1024);
+    printf("|Level|Copy<br>(GB/s)|Scale<br>(GB/s)|Add<br>(GB/s)"
+        "|Triad<br>(GB/s)|Reduce<br>(GB/s)|\n");
+    printf("|:--:|--:|--:|--:|--:|--:|\n");
+
+    for (const char* level : { "L1", "L2", "LLC", "DRAM" }) {
+        if (best.count(level) == 0) { continue; }
+
+        printf("|%s|", level);
+        for (auto bandwidth : best[level]) {
+            // (a kernel may not have had a working set at every level)
+            if (bandwidth > 0.0) { printf("%.2f|", bandwidth); }
+            else { printf("-|"); }
+        }
+        printf("\n");
+    }
+}